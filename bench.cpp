@@ -0,0 +1,670 @@
+// Microbenchmarks for the parts of the macro pipeline that build on Linux,
+// and one end to end run from a synthetic frame to the input it causes.
+// Every allocation goes through the counting operator new below.
+//
+//   bench [--json <file>]   --json also writes every result to file (- for
+//                           stdout) to compare between versions
+#include "foreground.h"
+#include "framesource.h"
+#include "framestats.h"
+#include "hookdispatch.h"
+#include "keymap.h"
+#include "keysource.h"
+#include "macro.h"
+#include "macrofile.h"
+#include "outputsink.h"
+#include "rtssreader.h"
+#include "scheduler.h"
+#include "task.h"
+#include "taskring.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <new>
+#include <optional>
+#include <queue>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *p = malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace Bench {
+using Clock = std::chrono::steady_clock;
+
+volatile uint32_t sink;
+void sendKey(uint16_t vkCode, bool press) { sink = sink + vkCode + press; }
+
+// The shift+221 macro from addKeybinds, already expanded into key steps
+enum StepKind { Press, Down, Up, Sleep };
+struct Step {
+  uint16_t vkCode;
+  StepKind kind;
+  bool recursive;
+  int amount;
+};
+const Step macro[] = {{'M', Press, true, 1},   {0x0D, Down, false, 1}, {0x26, Press, false, 6},
+                      {0x0D, Up, false, 1},    {0x28, Down, true, 1},  {0x0D, Down, false, 1},
+                      {0x28, Up, false, 1},    {0x0D, Up, true, 1},    {0, Sleep, false, 2},
+                      {0x20, Down, true, 1},   {'M', Down, false, 1},  {'M', Up, true, 1},
+                      {0x20, Up, false, 1}};
+
+// What queueInput/executeFirstQueuedTask used to do
+namespace Old {
+struct Task {
+  int delay;
+  std::optional<std::function<void()>> function;
+  bool recursive;
+};
+std::queue<Task> queuedTasks;
+
+void queueKey(uint16_t vkCode, bool press, bool recursive) {
+  queuedTasks.push({0, [vkCode, press]() { sendKey(vkCode, press); }, recursive});
+}
+
+void queueMacro() {
+  for (const Step &step : macro) {
+    for (int i = 0; i < step.amount; i++) {
+      switch (step.kind) {
+      case Press:
+        queueKey(step.vkCode, true, false);
+        queueKey(step.vkCode, false, step.recursive);
+        break;
+      case Down:
+      case Up:
+        queueKey(step.vkCode, step.kind == Down, step.recursive);
+        break;
+      case Sleep:
+        queuedTasks.push({0, std::nullopt, step.recursive});
+        break;
+      }
+    }
+  }
+}
+
+void drain() {
+  while (!queuedTasks.empty()) {
+    Task firstTaskCopy = queuedTasks.front();
+    queuedTasks.pop();
+    if (firstTaskCopy.function.has_value()) {
+      firstTaskCopy.function.value()();
+    }
+  }
+}
+} // namespace Old
+
+namespace New {
+using InputHandler::Task;
+using InputHandler::TaskType;
+TaskRing<Task, 1024> queuedTasks;
+
+void queueMacro() {
+  for (const Step &step : macro) {
+    for (int i = 0; i < step.amount; i++) {
+      switch (step.kind) {
+      case Press:
+        queuedTasks.push(Task::key(step.vkCode, true, false));
+        queuedTasks.push(Task::key(step.vkCode, false, step.recursive));
+        break;
+      case Down:
+      case Up:
+        queuedTasks.push(Task::key(step.vkCode, step.kind == Down, step.recursive));
+        break;
+      case Sleep:
+        queuedTasks.push(Task::sleep(step.recursive));
+        break;
+      }
+    }
+  }
+}
+
+void drain() {
+  while (Task *firstTask = queuedTasks.front()) {
+    Task task = std::move(*firstTask);
+    queuedTasks.pop();
+    if (task.type == TaskType::KeyDown || task.type == TaskType::KeyUp) {
+      sendKey(task.vkCode, task.type == TaskType::KeyDown);
+    }
+  }
+}
+
+// Same drain, but a frame's worth of recursive tasks goes to the sink in one
+// batch like executeFirstQueuedTask does now
+OutputSink::RecordingSink recordingSink;
+OutputSink::Batch batch;
+
+void drainBatched() {
+  while (Task *firstTask = queuedTasks.front()) {
+    Task task = std::move(*firstTask);
+    queuedTasks.pop();
+    if (task.type == TaskType::KeyDown || task.type == TaskType::KeyUp) {
+      batch.add(recordingSink, task.vkCode, task.type == TaskType::KeyDown);
+    }
+    if (!task.recursive) {
+      batch.flush(recordingSink);
+    }
+  }
+  batch.flush(recordingSink);
+  recordingSink.recorded.clear();
+}
+} // namespace New
+
+// findKey before the table went constexpr: a linear scan over std::string
+// names after lowercasing a copy of the input
+namespace OldFindKey {
+struct key_to_vk_type {
+  std::string keyName;
+  int vkCode;
+};
+std::vector<key_to_vk_type> g_key_to_vk;
+
+std::optional<uint16_t> findKey(const std::string &keyToFind) {
+  std::string lowerCaseKey = keyToFind;
+  std::transform(lowerCaseKey.begin(), lowerCaseKey.end(), lowerCaseKey.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  for (size_t i = 0; i < g_key_to_vk.size(); ++i) {
+    if (g_key_to_vk[i].keyName == lowerCaseKey) {
+      return g_key_to_vk[i].vkCode;
+    }
+  }
+  return std::nullopt;
+}
+} // namespace OldFindKey
+
+// Every table name, capitalized like people write them in macros ("Enter")
+std::vector<std::string> keyNames() {
+  std::vector<std::string> names;
+  for (const key_to_vk_type &key : g_key_to_vk) {
+    std::string name(key.keyName);
+    name[0] = std::toupper(name[0]);
+    names.push_back(name);
+    OldFindKey::g_key_to_vk.push_back({std::string(key.keyName), key.vkCode});
+  }
+  return names;
+}
+
+// onKeyPress before the dispatch table: every keybind checked per event,
+// modifiers looked up by name each time
+namespace OldDispatch {
+struct Keybind {
+  uint32_t keyCode;
+  bool isPressed;
+  std::function<void()> function;
+  std::vector<std::string> modifiers;
+};
+std::vector<Keybind> keybinds;
+HookDispatch::KeyMask asyncKeyState; // stands in for GetAsyncKeyState
+
+bool getPhysicalKeyState(uint16_t vkCode) {
+  for (Keybind &keybind : keybinds) {
+    if (vkCode == keybind.keyCode) {
+      return keybind.isPressed;
+    }
+  }
+  return vkCode <= 0xFF && asyncKeyState.test(vkCode);
+}
+
+bool onKeyDown(uint32_t vkCode) {
+  for (Keybind &keybind : keybinds) {
+    bool modifiersPressed =
+        keybind.modifiers.size() != 0
+            ? std::all_of(keybind.modifiers.begin(), keybind.modifiers.end(),
+                          [](std::string modifier) {
+                            return getPhysicalKeyState(OldFindKey::findKey(modifier).value());
+                          })
+            : true;
+    if (vkCode == keybind.keyCode && !keybind.isPressed && modifiersPressed) {
+      keybind.isPressed = true;
+      keybind.function();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool onKeyUp(uint32_t vkCode) {
+  for (Keybind &keybind : keybinds) {
+    if (vkCode == keybind.keyCode) {
+      keybind.isPressed = false;
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace OldDispatch
+
+// The four keybinds from addKeybinds and a stream of typing with shift held
+// now and then, which is what the hook sees all day
+struct KeyEvent {
+  uint8_t vkCode;
+  bool down;
+};
+HookDispatch::Dispatcher dispatcher;
+HookDispatch::KeyState keyState;
+std::vector<KeyEvent> keyEvents;
+
+void setUpDispatch() {
+  auto fire = []() { sink = sink + 1; };
+  OldDispatch::keybinds = {{220, false, fire, {}},
+                           {0x71, false, fire, {}},
+                           {221, false, fire, {"shift"}},
+                           {186, false, fire, {"shift"}}};
+  dispatcher.add(220, {}, fire);
+  dispatcher.add(0x71, {}, fire);
+  dispatcher.add(221, {0x10}, fire);
+  dispatcher.add(186, {0x10}, fire);
+
+  const uint8_t typed[] = {'W', 'A', 'S', 'D', 'E', 0x20, 0xA0, 220, 221, 186, 0x71, 'M', 0x0D};
+  uint32_t seed = 12345;
+  for (int i = 0; i < 4096; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint8_t vkCode = typed[(seed >> 16) % sizeof(typed)];
+    keyEvents.push_back({vkCode, true});
+    keyEvents.push_back({vkCode, false});
+  }
+}
+
+// Bound key events with an alt-tab every 512 of them. The old hook looked the
+// foreground process up on every one.
+Foreground::FakeProvider foregroundProvider;
+Foreground::Tracker foregroundTracker(foregroundProvider);
+
+void setUpForeground() {
+  foregroundProvider.processNames = {{1, "GTA5_Enhanced.exe"}, {2, "Discord.exe"}};
+  foregroundProvider.foreground = 1;
+  foregroundTracker.setTarget("GTA5_Enhanced.exe");
+}
+
+bool oldIsTargetFocused() {
+  static std::string name;
+  uint32_t processId;
+  return foregroundProvider.processName(foregroundProvider.foregroundWindow(), name, processId) &&
+         name == "GTA5_Enhanced.exe";
+}
+
+// Everything measured, for --json
+struct Result {
+  std::string name;
+  double nsPerIter;
+  double allocsPerIter;
+};
+struct LatencyResult {
+  std::string name;
+  size_t samples;
+  double p50Us, p99Us, maxUs;
+};
+std::vector<Result> results;
+std::vector<LatencyResult> latencyResults;
+
+template <typename F> void run(const char *name, int iterations, F &&body) {
+  body(); // warm up, the first std::queue chunk and friends
+  size_t allocationsBefore = allocations;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < iterations; i++) {
+    body();
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  double allocs = double(allocations - allocationsBefore) / iterations;
+  printf("%-32s %10.1f ns/iter %8.2f allocs/iter\n", name, ns / iterations, allocs);
+  results.push_back({name, ns / iterations, allocs});
+}
+
+// Sorts samples (ns)
+void reportLatency(const char *name, std::vector<int64_t> &samples) {
+  if (samples.empty()) {
+    printf("%s: no samples\n", name);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  LatencyResult result = {name, samples.size(), samples[samples.size() / 2] / 1000.0,
+                          samples[samples.size() * 99 / 100] / 1000.0, samples.back() / 1000.0};
+  printf("%-32s %zu samples, p50 %.2fus p99 %.2fus max %.2fus\n", name, result.samples,
+         result.p50Us, result.p99Us, result.maxUs);
+  latencyResults.push_back(result);
+}
+
+bool writeJson(const char *path) {
+  FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+  // Names are ours, none of them need escaping
+  fprintf(file, "{\n  \"version\": 1,\n  \"results\": [");
+  for (size_t i = 0; i < results.size(); i++) {
+    fprintf(file, "%s\n    {\"name\": \"%s\", \"ns_per_iter\": %.1f, \"allocs_per_iter\": %.2f}",
+            i == 0 ? "" : ",", results[i].name.c_str(), results[i].nsPerIter,
+            results[i].allocsPerIter);
+  }
+  fprintf(file, "\n  ],\n  \"latency\": [");
+  for (size_t i = 0; i < latencyResults.size(); i++) {
+    const LatencyResult &result = latencyResults[i];
+    fprintf(file, "%s\n    {\"name\": \"%s\", \"samples\": %zu, \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}",
+            i == 0 ? "" : ",", result.name.c_str(), result.samples, result.p50Us, result.p99Us,
+            result.maxUs);
+  }
+  fprintf(file, "\n  ]\n}\n");
+  if (file != stdout) {
+    fclose(file);
+  }
+  return true;
+}
+
+// The shift+221 macro as strings, what queueInputs used to parse on every press
+const std::vector<std::string> macroInputs = {
+    "mR",          "enter down", "up 6",   "enter up",  "down downR", "enter down", "down up",
+    "enter upR",   "sleep 2",    "space downR", "m down", "m upR",      "space up"};
+
+const char *macroFile = R"(# the built in macros
+220 = mR, enter down, enter up, enter downR, down 4, enter up, enter downR, down down, enter up, down up
+F2 = mR, enter down, up 7, enter up, enter, sleep, enter, enter downR, up down, enter up, up up, m
+shift+221 = mR, enter down, up 6, enter up, down downR, enter down, down up, enter upR, sleep 2, space downR, m down, m upR, space up
+shift+186 = mR, enter down, up 7, enter up, down downR, enter down, down up, down, enter up
+F6 lane 1 held = enter downR, t, hR, eR, lR, lR, o, enter up
+)";
+
+// A RTSSSharedMemoryV2 with the game in slot 2, like fakertss write makes.
+// False if one already exists, fakertss is probably running.
+bool createFakeSegment() {
+  const uint32_t entrySize = 4096, entryCount = 4;
+  std::string name = std::string("/") + RTSSReader::sharedMemoryName;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  size_t size = sizeof(RTSSReader::SharedMemoryHeader) + entrySize * entryCount;
+  void *view = ftruncate(fd, size) == 0
+                   ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                   : MAP_FAILED;
+  close(fd);
+  if (view == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+  auto *header = static_cast<RTSSReader::SharedMemoryHeader *>(view);
+  header->dwVersion = RTSSReader::minimumVersion;
+  header->dwAppEntrySize = entrySize;
+  header->dwAppArrOffset = sizeof(RTSSReader::SharedMemoryHeader);
+  header->dwAppArrSize = entryCount;
+  header->dwSignature = RTSSReader::sharedMemorySignature;
+  auto *entry = reinterpret_cast<RTSSReader::AppEntry *>(static_cast<char *>(view) +
+                                                         header->dwAppArrOffset + 2 * entrySize);
+  entry->dwProcessID = 1234;
+  strcpy(entry->szName, "C:\\Games\\GTA5.exe");
+  entry->dwFrames = 77;
+  entry->dwFrameTime = 6944;
+  bool opened = RTSSReader::openSharedMemory();
+  shm_unlink(name.c_str()); // stays mapped, nothing left behind
+  return opened;
+}
+
+// Presents a frame every period from the first poll on. detectedAt is when
+// poll noticed, present when it was due, like a game and a poll loop.
+class SyntheticSource : public FrameSource::Source {
+public:
+  explicit SyntheticSource(std::chrono::nanoseconds period) : period(period) {}
+
+  bool poll(FrameSource::Frame &frame) override {
+    Clock::time_point now = Clock::now();
+    if (index == 0) {
+      next = now;
+    }
+    if (now < next) {
+      return false;
+    }
+    present = next;
+    next += period;
+    frame = {++index, 1, period.count() / 1e6, now};
+    return true;
+  }
+  void reset() override { index = 0; }
+
+  std::chrono::nanoseconds period;
+  std::atomic<Clock::time_point> present; // of the last frame, read by the sink
+  uint64_t index = 0;
+
+private:
+  Clock::time_point next;
+};
+
+// Time from the frame's present to each batch the scheduler submits, up to
+// wanted of them. samples belongs to the engine thread until it's joined,
+// collected is what other threads can look at meanwhile.
+class TimingSink : public OutputSink::Sink {
+public:
+  TimingSink(SyntheticSource &source, size_t wanted) : source(source), wanted(wanted) {
+    samples.reserve(wanted);
+  }
+
+  void submit(const OutputSink::Event *, size_t) override {
+    if (samples.size() < wanted) {
+      samples.push_back((Clock::now() - source.present.load(std::memory_order_relaxed)).count());
+      collected.store(samples.size(), std::memory_order_release);
+    }
+  }
+  bool full() const { return collected.load(std::memory_order_acquire) >= wanted; }
+
+  SyntheticSource &source;
+  const size_t wanted;
+  std::vector<int64_t> samples;
+  std::atomic<size_t> collected = 0;
+};
+} // namespace Bench
+
+int main(int argc, char **argv) {
+  const char *jsonPath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      jsonPath = argv[++i];
+    }
+  }
+  const int iterations = 200000;
+  printf("sizeof(Task): %zu\n", sizeof(InputHandler::Task));
+  Bench::run("macro queue+drain, old Task", iterations, []() {
+    Bench::Old::queueMacro();
+    Bench::Old::drain();
+  });
+  Bench::run("macro queue+drain, new Task", iterations, []() {
+    Bench::New::queueMacro();
+    Bench::New::drain();
+  });
+
+  Bench::run("macro queue+drain, batched", iterations, []() {
+    Bench::New::queueMacro();
+    Bench::New::drainBatched();
+  });
+  printf("%.2f SendInput calls per macro\n",
+         double(Bench::New::recordingSink.batches) / (iterations + 1));
+
+  std::vector<std::string> names = Bench::keyNames();
+  Bench::run("findKey full key set, linear", 20000, [&]() {
+    for (const std::string &name : names) {
+      Bench::sink = Bench::sink + Bench::OldFindKey::findKey(name).value();
+    }
+  });
+  Bench::run("findKey full key set, sorted", 20000, [&]() {
+    for (const std::string &name : names) {
+      Bench::sink = Bench::sink + KeyMap::lookupKey(name).value();
+    }
+  });
+
+  Bench::setUpDispatch();
+  const size_t events = Bench::keyEvents.size();
+  Bench::run("hook dispatch 8192 events, list", 200, [&]() {
+    for (const Bench::KeyEvent &event : Bench::keyEvents) {
+      event.down ? Bench::OldDispatch::asyncKeyState.set(event.vkCode)
+                 : Bench::OldDispatch::asyncKeyState.clear(event.vkCode);
+      Bench::sink = Bench::sink + (event.down ? Bench::OldDispatch::onKeyDown(event.vkCode)
+                                              : Bench::OldDispatch::onKeyUp(event.vkCode));
+    }
+  });
+  Bench::run("hook dispatch 8192 events, table", 200, [&]() {
+    for (const Bench::KeyEvent &event : Bench::keyEvents) {
+      Bench::keyState.set(event.vkCode, event.down);
+      Bench::sink = Bench::sink + (event.down ? Bench::dispatcher.onKeyDown(event.vkCode, Bench::keyState)
+                                              : Bench::dispatcher.onKeyUp(event.vkCode));
+    }
+  });
+  printf("(%zu events per iteration)\n", events);
+
+  Bench::setUpForeground();
+  Bench::run("focus check 8192 events, lookup", 200, [&]() {
+    for (int i = 0; i < 8192; i++) {
+      if (i % 512 == 0) {
+        Bench::foregroundProvider.foreground ^= 3;
+      }
+      Bench::sink = Bench::sink + Bench::oldIsTargetFocused();
+    }
+  });
+  uint64_t lookupsBefore = Bench::foregroundProvider.lookups;
+  Bench::run("focus check 8192 events, cached", 200, [&]() {
+    for (int i = 0; i < 8192; i++) {
+      if (i % 512 == 0) {
+        Bench::foregroundProvider.foreground ^= 3;
+      }
+      Bench::sink = Bench::sink + Bench::foregroundTracker.isTargetFocused();
+    }
+  });
+  printf("cached focus check: %llu lookups, %.2f%% hit rate\n",
+         (unsigned long long)(Bench::foregroundProvider.lookups - lookupsBefore),
+         100.0 * Bench::foregroundTracker.hits /
+             (Bench::foregroundTracker.hits + Bench::foregroundTracker.misses));
+
+  // Everything the Windows hook procedure does, through the same key source
+  // interface it's behind
+  HookDispatch::Router router(Bench::foregroundTracker);
+  router.swap(&Bench::dispatcher);
+  KeySource::ScriptedSource keySource;
+  for (const Bench::KeyEvent &event : Bench::keyEvents) {
+    keySource.events.push_back({event.vkCode, event.down, false});
+  }
+  keySource.start(router);
+  Bench::run("key source+router 8192 events", 200, [&]() { keySource.run(); });
+  printf("%llu of %zu events eaten\n", (unsigned long long)keySource.eaten / 201, events);
+
+  Bench::run("macro compile, shift+221", 20000, []() {
+    Macro::Program program;
+    std::vector<Macro::ParseError> errors;
+    Macro::compile(Bench::macroInputs, program, errors);
+    Bench::sink = Bench::sink + program.instructions.size();
+  });
+  std::vector<MacroFile::Entry> entries, reloaded;
+  std::vector<MacroFile::Error> errors;
+  MacroFile::parse(Bench::macroFile, nullptr, entries, errors);
+  Bench::run("macro file reload, 5 macros", 20000, [&]() {
+    MacroFile::parse(Bench::macroFile, &entries, reloaded, errors);
+  });
+
+  if (Bench::createFakeSegment()) {
+    RTSSReader::targetProcess = "GTA5.exe";
+    Bench::run("getRawFrametime, fake segment", iterations, []() {
+      Bench::sink = Bench::sink + (uint32_t)RTSSReader::getRawFrametime().value_or(0);
+    });
+  } else {
+    printf("getRawFrametime skipped, RTSSSharedMemoryV2 exists (fakertss running?)\n");
+  }
+
+  // A held macro on every lane, one step per lane per frame like the frame
+  // thread runs it
+  const Macro::Program *program = Macro::compileOrReport("shift+221", Bench::macroInputs);
+  OutputSink::RecordingSink schedulerSink;
+  InputHandler::outputSink = &schedulerSink;
+  InputHandler::executionMode = InputHandler::ExecutionMode::Synchronous;
+  InputHandler::isKeyHeld = [](uint16_t) { return true; };
+  FrameSource::Frame frame = {0, 1, 1000.0 / 240, {}};
+  for (int lane = 0; lane < InputHandler::maxLanes; lane++) {
+    InputHandler::queueTask(InputHandler::Task::runWhileHeld(program, 0x70 + lane), lane);
+  }
+  Bench::run("executeFirstQueuedTask, 8 lanes", iterations, [&]() {
+    frame.index++;
+    InputHandler::executeFirstQueuedTask(frame);
+    schedulerSink.recorded.clear();
+  });
+  InputHandler::resetQueue();
+
+  // Jittery 144fps with a hitch now and then, so the percentile cursors
+  // have something to follow
+  FrameStats::Tracker frameStats;
+  FrameSource::Frame statsFrame = {0, 1, 0, {}};
+  uint32_t jitter = 1;
+  Bench::run("frame stats update", iterations, [&]() {
+    jitter = jitter * 1664525 + 1013904223;
+    statsFrame.index++;
+    statsFrame.frametime = statsFrame.index % 500 == 0 ? 40 : 6.5 + (jitter >> 24) / 256.0;
+    frameStats.onFrame(statsFrame);
+    Bench::sink = Bench::sink + frameStats.holding();
+  });
+  FrameStats::Summary pacing = frameStats.overall();
+  printf("p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms, %llu hitches\n", pacing.p50, pacing.p95,
+         pacing.p99, pacing.max, (unsigned long long)frameStats.hitches);
+
+  // Published for real, so monitor can watch the end to end run below
+  Telemetry::Writer telemetry;
+  if (telemetry.open()) {
+    Telemetry::FrameBlock frameBlock = {};
+    Bench::run("telemetry publish, frame block", iterations, [&]() {
+      frameBlock.index++;
+      telemetry.publish(frameBlock);
+    });
+    Telemetry::StepBlock stepBlock = {};
+    Bench::run("telemetry publish, step block", iterations, [&]() {
+      stepBlock.frames++;
+      telemetry.publish(stepBlock);
+    });
+    router.telemetry = &telemetry;
+    Bench::run("key source+router, telemetry", 200, [&]() { keySource.run(); });
+    router.telemetry = nullptr;
+    InputHandler::telemetry = &telemetry;
+  } else {
+    printf("telemetry skipped, %s is being published\n", Telemetry::segmentName);
+  }
+
+  // End to end: the real engine and waiter polling a 1000 fps source, the
+  // inline scheduler running a held macro, inputs timed at the sink
+  Bench::SyntheticSource source(std::chrono::milliseconds(1));
+  Bench::TimingSink timingSink(source, 4000);
+  InputHandler::outputSink = &timingSink;
+  InputHandler::executionMode = InputHandler::ExecutionMode::Inline;
+  InputHandler::queueTask(InputHandler::Task::runWhileHeld(program, 0x70));
+  FrameSource::Engine engine(
+      source, [](const FrameSource::Frame &frame) { InputHandler::onFrame(frame); },
+      []() { return InputHandler::tasksQueued(); });
+  std::thread engineThread([&]() { engine.run(); });
+  while (!timingSink.full()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  engine.stop();
+  engineThread.join();
+  InputHandler::resetQueue();
+  Bench::reportLatency("frame present to input", timingSink.samples);
+  printf("(%llu frames, %llu missed, %llu sleeps %llu yields %llu spins)\n",
+         (unsigned long long)engine.framesSeen, (unsigned long long)engine.framesMissed,
+         (unsigned long long)engine.waiter.sleeps, (unsigned long long)engine.waiter.yields,
+         (unsigned long long)engine.waiter.spins);
+
+  InputHandler::telemetry = nullptr;
+  telemetry.close();
+
+  if (jsonPath != nullptr && !Bench::writeJson(jsonPath)) {
+    perror(jsonPath);
+    return 1;
+  }
+  return 0;
+}
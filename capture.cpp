@@ -0,0 +1,150 @@
+#include "capture.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Capture {
+
+bool Writer::open(const char *path) {
+  close();
+  file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  FileHeader header = {fileMagic, fileVersion, sizeof(Record), 0};
+  fwrite(&header, sizeof(header), 1, file);
+  fflush(file);
+  start = std::chrono::steady_clock::now();
+  tracked = 0;
+  replaceNext = 0;
+  written = 0;
+  return true;
+}
+
+void Writer::append(const RTSSReader::EntrySnapshot &snapshot) {
+  if (file == nullptr) {
+    return;
+  }
+  RTSSReader::EntrySnapshot *previous = nullptr;
+  for (int i = 0; i < tracked; i++) {
+    if (last[i].processId == snapshot.processId) {
+      previous = &last[i];
+    }
+  }
+  if (previous == nullptr) {
+    if (tracked < RTSSReader::maxInstances) {
+      previous = &last[tracked++];
+    } else {
+      previous = &last[replaceNext];
+      replaceNext = (replaceNext + 1) % RTSSReader::maxInstances;
+    }
+  } else if (snapshot.time0 == previous->time0 && snapshot.time1 == previous->time1 &&
+             snapshot.frames == previous->frames && snapshot.frameTime == previous->frameTime &&
+             snapshot.osdFrame == previous->osdFrame) {
+    return;
+  }
+  *previous = snapshot;
+
+  Record record = {};
+  record.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  record.processId = snapshot.processId;
+  record.time0 = snapshot.time0;
+  record.time1 = snapshot.time1;
+  record.frames = snapshot.frames;
+  record.frameTime = snapshot.frameTime;
+  record.statFramerateAvg = snapshot.statFramerateAvg;
+  record.osdFrame = snapshot.osdFrame;
+  // stdio buffers this, it's one 40 byte memcpy per frame. Flushed now and
+  // then since the tool usually gets closed with Ctrl+C mid capture.
+  fwrite(&record, sizeof(record), 1, file);
+  if (++written % 256 == 0) {
+    fflush(file);
+  }
+}
+
+void Writer::close() {
+  if (file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+}
+
+bool Reader::open(const char *path) {
+  close();
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart < (long long)sizeof(FileHeader)) {
+    CloseHandle(fileHandle);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingW(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(fileHandle);
+  if (mapping == NULL) {
+    return false;
+  }
+  view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping); // the view keeps the mapping alive
+  if (view == nullptr) {
+    return false;
+  }
+  viewSize = (size_t)size.QuadPart;
+#else
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(FileHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  view = mapped;
+  viewSize = status.st_size;
+#endif
+
+  const FileHeader *header = static_cast<const FileHeader *>(view);
+  if (header->magic != fileMagic || header->version != fileVersion ||
+      header->recordSize != sizeof(Record)) {
+    close();
+    return false;
+  }
+  records = reinterpret_cast<const Record *>(static_cast<const char *>(view) + sizeof(FileHeader));
+  count = (viewSize - sizeof(FileHeader)) / sizeof(Record);
+  return true;
+}
+
+void Reader::close() {
+  if (view != nullptr) {
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap(const_cast<void *>(view), viewSize);
+#endif
+  }
+  view = nullptr;
+  viewSize = 0;
+  records = nullptr;
+  count = 0;
+}
+} // namespace Capture
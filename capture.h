@@ -0,0 +1,88 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "rtssreader.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Recordings of what the game's RTSS entry looked like, for replaying real
+// game load through the frame detection later. The file is a FileHeader
+// followed by fixed size Records and nothing else, so it can be appended to
+// while capturing and mapped straight into memory when replaying. A capture
+// that got cut off is still readable up to the last whole record. Every
+// running instance of the game gets records of its own, processId tells
+// them apart.
+namespace Capture {
+constexpr uint32_t fileMagic = 0x50435452; // 'RTCP'
+constexpr uint32_t fileVersion = 1;
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t reserved;
+};
+
+// One snapshot that differed from the one before it of the same process
+struct Record {
+  int64_t timestampNs; // since the capture started
+  uint32_t processId;
+  uint32_t time0;
+  uint32_t time1;
+  uint32_t frames;
+  uint32_t frameTime; // microseconds
+  uint32_t statFramerateAvg;
+  uint32_t osdFrame;
+  uint32_t reserved;
+
+  RTSSReader::EntrySnapshot snapshot() const {
+    return {processId, time0, time1, frames, frameTime, statFramerateAvg, osdFrame};
+  }
+};
+
+static_assert(sizeof(FileHeader) == 16);
+static_assert(sizeof(Record) == 40);
+
+class Writer {
+public:
+  ~Writer() { close(); }
+
+  bool open(const char *path);
+  // Skips snapshots that are the same as the last one written for their
+  // process
+  void append(const RTSSReader::EntrySnapshot &snapshot);
+  void close();
+
+  uint64_t written = 0;
+
+private:
+  FILE *file = nullptr;
+  std::chrono::steady_clock::time_point start;
+  RTSSReader::EntrySnapshot last[RTSSReader::maxInstances] = {};
+  int tracked = 0;     // how many of last are in use
+  int replaceNext = 0; // once they all are, a new process takes this one
+};
+
+// Maps a capture read only
+class Reader {
+public:
+  Reader() = default;
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+  ~Reader() { close(); }
+
+  bool open(const char *path);
+  void close();
+
+  const Record *records = nullptr;
+  size_t count = 0;
+
+private:
+  const void *view = nullptr;
+  size_t viewSize = 0;
+};
+} // namespace Capture
+
+#endif
@@ -1 +1 @@
-clang++ -g -Wall -O3 -flto -march=native -fuse-ld=lld --std=c++23 main.cpp keymap.cpp -luser32
\ No newline at end of file
+clang++ -g -Wall -O3 -flto -march=native -fuse-ld=lld --std=c++23 -DNOMINMAX main.cpp keymap.cpp rtssreader.cpp framesource.cpp macro.cpp hookdispatch.cpp foreground.cpp outputsink.cpp trace.cpp scheduler.cpp telemetry.cpp capture.cpp framegen.cpp framepredictor.cpp framestats.cpp macrofile.cpp keysource.cpp process.cpp -luser32
\ No newline at end of file
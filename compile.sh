@@ -0,0 +1,8 @@
+#!/bin/sh
+# Linux tools, the macro tool itself is built with compile.bat
+clang++ -g -Wall -O3 -march=native --std=c++23 fakertss.cpp rtssreader.cpp process.cpp framesource.cpp trace.cpp capture.cpp -o fakertss -lrt -pthread
+clang++ -g -Wall -O3 -march=native --std=c++23 bench.cpp hookdispatch.cpp keysource.cpp foreground.cpp macro.cpp macrofile.cpp keymap.cpp scheduler.cpp telemetry.cpp framegen.cpp framepredictor.cpp framestats.cpp trace.cpp framesource.cpp rtssreader.cpp capture.cpp process.cpp -o bench -lrt -pthread
+clang++ -g -Wall -O3 -march=native --std=c++23 simulate.cpp simulator.cpp scheduler.cpp telemetry.cpp framegen.cpp framepredictor.cpp framestats.cpp macro.cpp macrofile.cpp keymap.cpp trace.cpp -o simulate -pthread
+clang++ -g -Wall -O3 -march=native --std=c++23 monitor.cpp telemetry.cpp -o monitor -lrt -pthread
+# Frame timing of the keybinds.h macros, fails the build if an input moved
+./simulate test
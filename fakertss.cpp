@@ -0,0 +1,438 @@
+// POSIX stand-in for RivaTuner Statistics Server so the frame detection can be
+// run and benchmarked on Linux.
+//
+//   fakertss write <process> <fps> [instances]
+//                                    publish RTSSSharedMemoryV2 and present
+//                                    frames at a fixed rate (flat frametimes,
+//                                    like an RTSS FPS cap). Further instances
+//                                    of the game run at fps/2, fps/3...
+//   fakertss watch <process> [mode]  run the frame engine against it and
+//                                    print detected/missed frames and CPU use.
+//                                    Waits for a process with that name and
+//                                    for the shared memory like main.cpp.
+//                                    mode is inline (default) or executor,
+//                                    like main.cpp's --executor. With a trace
+//                                    file the events go there too.
+//   fakertss hammer <seconds>        rewrite an entry from a thread as fast as
+//                                    possible and count how many snapshots
+//                                    had to be retried or came back torn.
+//                                    Fails if any torn one was accepted.
+//   fakertss capture <process> <file> <seconds>
+//                                    record the entry of every instance to a
+//                                    capture file
+//   fakertss replay <file> [speed] [pid]
+//                                    run the frame engine on a capture, speed
+//                                    1 is real time and 0 as fast as possible.
+//                                    Replays one instance, the first captured
+//                                    one unless pid says otherwise.
+//   fakertss find [process...]       which of the processes (the games by
+//                                    default) is running, as initialize sees it
+#include "capture.h"
+#include "framesource.h"
+#include "process.h"
+#include "rtssreader.h"
+#include "taskexecutor.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace FakeRTSS {
+// Real RTSS entries are much bigger, keep some room so nobody relies on
+// sizeof(AppEntry) being the stride
+constexpr uint32_t appEntrySize = 4096;
+constexpr uint32_t appArrSize = 8;
+
+RTSSReader::SharedMemoryHeader *header;
+std::string segmentPath = std::string("/") + RTSSReader::sharedMemoryName;
+
+// The segment outlives us otherwise, and the next run's reader would map a
+// stale one before the next writer got to it
+void removeSegment() { shm_unlink(segmentPath.c_str()); }
+
+void onInterrupt(int) {
+  removeSegment();
+  _exit(130);
+}
+
+RTSSReader::AppEntry *getEntry(uint32_t i) {
+  char *base = reinterpret_cast<char *>(header);
+  return reinterpret_cast<RTSSReader::AppEntry *>(base + header->dwAppArrOffset + i * header->dwAppEntrySize);
+}
+
+bool create() {
+  int fd = shm_open(segmentPath.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  signal(SIGINT, onInterrupt);
+  signal(SIGTERM, onInterrupt);
+  size_t size = sizeof(RTSSReader::SharedMemoryHeader) + appEntrySize * appArrSize;
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    removeSegment();
+    return false;
+  }
+  void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    removeSegment();
+    return false;
+  }
+  memset(view, 0, size);
+  header = static_cast<RTSSReader::SharedMemoryHeader *>(view);
+  header->dwVersion = 0x00020015;
+  header->dwAppEntrySize = appEntrySize;
+  header->dwAppArrOffset = sizeof(RTSSReader::SharedMemoryHeader);
+  header->dwAppArrSize = appArrSize;
+  header->dwSignature = RTSSReader::sharedMemorySignature;
+  return true;
+}
+
+uint32_t nowMs() {
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+// Mirrors what RTSS does on every present
+void present(RTSSReader::AppEntry *entry, uint32_t frametimeUs) {
+  volatile RTSSReader::AppEntry *e = entry;
+  uint32_t now = nowMs();
+  e->dwFrames = e->dwFrames + 1;
+  e->dwTime1 = now;
+  e->dwFrameTime = frametimeUs;
+  if (now - e->dwTime0 >= 1000) {
+    e->dwTime0 = now;
+    e->dwFrames = 0;
+  }
+}
+
+int write(const char *process, double fps, int instances) {
+  if (!create()) {
+    perror("shm");
+    return 1;
+  }
+  // Something else RTSS hooked first so the target isn't always slot 0
+  RTSSReader::AppEntry *other = getEntry(0);
+  other->dwProcessID = 1000;
+  strcpy(other->szName, "C:\\Windows\\explorer.exe");
+
+  // More instances of the same game, each one at fps / its number so their
+  // clocks can be told apart
+  instances = std::clamp(instances, 1, (int)appArrSize - 1);
+  std::chrono::steady_clock::duration periods[appArrSize];
+  std::chrono::steady_clock::time_point next[appArrSize];
+  for (int i = 0; i < instances; i++) {
+    RTSSReader::AppEntry *entry = getEntry(1 + i);
+    entry->dwProcessID = getpid() + i;
+    snprintf(entry->szName, sizeof(entry->szName), "C:\\Games\\%s", process);
+    entry->dwTime0 = nowMs();
+    periods[i] = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>((i + 1) / fps));
+    next[i] = std::chrono::steady_clock::now() + periods[i];
+    printf("presenting %s (pid %d) at %.1f fps\n", process, (int)entry->dwProcessID, fps / (i + 1));
+  }
+  fflush(stdout);
+  while (true) {
+    int due = std::min_element(next, next + instances) - next;
+    std::this_thread::sleep_until(next[due]);
+    present(getEntry(1 + due), std::chrono::duration_cast<std::chrono::microseconds>(periods[due]).count());
+    next[due] += periods[due];
+  }
+}
+
+double cpuMs() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+         usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+int watch(const char *process, bool useExecutor, const char *tracePath) {
+  // Attaches the way main.cpp does, so this and fakertss write can start in
+  // any order. process has to be running as well, sleep 1000 & for example.
+  static Process::ProcProbe probe;
+  static std::string_view names[1];
+  names[0] = process;
+  RTSSReader::startWatching(probe, nullptr, names);
+
+  // The frame task stands in for executeFirstQueuedTask: one task and one
+  // input per frame, which is all the executor hop changes
+  static Trace::Recorder recorder;
+  Trace::Exporter exporter(recorder);
+  if (!exporter.start(tracePath)) {
+    perror(tracePath);
+    return 1;
+  }
+  InputHandler::TaskExecutor executor;
+  executor.start();
+  auto frameTask = [](uint64_t frame) {
+    recorder.record(Trace::EventType::TaskDequeued, frame);
+    recorder.record(Trace::EventType::InputSubmitted, frame, 1);
+  };
+
+  // With several instances focus moves to the next one every report, like
+  // alt-tabbing between them
+  static std::atomic<uint32_t> focused = 0;
+  FrameSource::RTSSSource source(&focused);
+  FrameSource::Engine *engine;
+  auto lastReport = std::chrono::steady_clock::now();
+  double lastCpu = cpuMs();
+  uint64_t lastFrames = 0;
+  FrameSource::Engine watcher(
+      source,
+      [&](const FrameSource::Frame &frame) {
+        recorder.record(Trace::EventType::FrameDetected, frame.index, frame.advanced, frame.detectedAt);
+        if (useExecutor) {
+          executor.enqueue([&frameTask, index = frame.index]() { frameTask(index); });
+        } else {
+          frameTask(frame.index);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double wall = std::chrono::duration<double, std::milli>(now - lastReport).count();
+        if (wall < 1000) {
+          return;
+        }
+        double cpu = cpuMs();
+        printf("frame %llu: %llu frames/s, %llu missed total, period %.3fms, cpu %.1f%%, sleeps %llu yields %llu spins %llu, %s latency p50 <%lluus p99 <%lluus\n",
+               (unsigned long long)frame.index,
+               (unsigned long long)(engine->framesSeen - lastFrames),
+               (unsigned long long)engine->framesMissed, engine->waiter.periodMs(),
+               (cpu - lastCpu) * 100.0 / wall, (unsigned long long)engine->waiter.sleeps,
+               (unsigned long long)engine->waiter.yields, (unsigned long long)engine->waiter.spins,
+               useExecutor ? "executor" : "inline",
+               (unsigned long long)exporter.summary().frameToInput.percentileUs(0.5),
+               (unsigned long long)exporter.summary().frameToInput.percentileUs(0.99));
+        int instances = 0;
+        for (int i = 0; i < RTSSReader::maxInstances; i++) {
+          const FrameSource::RTSSSource::InstanceClock &clock = source.clocks()[i];
+          if (clock.processId != 0) {
+            instances++;
+            printf("  instance %u%s: %llu frames, frametime %.3fms\n", clock.processId,
+                   clock.processId == source.activeProcessId() ? " (active)" : "",
+                   (unsigned long long)clock.frames, clock.frametime);
+          }
+        }
+        if (instances > 1) {
+          for (int i = 1; i <= RTSSReader::maxInstances; i++) {
+            const FrameSource::RTSSSource::InstanceClock &clock =
+                source.clocks()[(frame.index + i) % RTSSReader::maxInstances];
+            if (clock.processId != 0 && clock.processId != source.activeProcessId()) {
+              focused = clock.processId;
+              break;
+            }
+          }
+        }
+        fflush(stdout);
+        lastReport = now;
+        lastCpu = cpu;
+        lastFrames = engine->framesSeen;
+      },
+      []() { return true; }); // Pretend a macro is always queued, the worst case
+  engine = &watcher;
+  watcher.run();
+  return 0;
+}
+int find(std::vector<std::string_view> names) {
+  if (names.empty()) {
+    names.assign(std::begin(RTSSReader::knownTargets), std::end(RTSSReader::knownTargets));
+  }
+  Process::ProcProbe probe;
+  auto start = std::chrono::steady_clock::now();
+  int found = probe.findRunning(names);
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("%s (%.3fms)\n", found < 0 ? "none running" : std::string(names[found]).c_str(), ms);
+  return found < 0 ? 1 : 0;
+}
+
+int hammer(double seconds) {
+  if (!create()) {
+    perror("shm");
+    return 1;
+  }
+  RTSSReader::AppEntry *entry = getEntry(3);
+  entry->dwProcessID = getpid();
+  strcpy(entry->szName, "C:\\Games\\hammer.exe");
+
+  RTSSReader::targetProcess = "hammer.exe";
+  if (!RTSSReader::openSharedMemory()) {
+    perror("shm");
+    removeSegment();
+    return 1;
+  }
+
+  // Every field holds the same sequence number once a write is complete, a
+  // snapshot with mixed values is one we shouldn't have accepted
+  std::atomic<bool> running = true;
+  std::thread writer([&]() {
+    volatile RTSSReader::AppEntry *e = entry;
+    for (uint32_t n = 1; running.load(std::memory_order_relaxed); n++) {
+      e->dwFrames = n;
+      e->dwTime1 = n;
+      e->dwFrameTime = n;
+      e->dwTime0 = n;
+      e->dwStatFramerateAvg = n;
+      e->dwOSDFrame = n;
+      // A few hundred ns between presents, still millions of frames/s
+      for (int i = 0; i < 64; i++) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      }
+    }
+  });
+
+  // Only count snapshots that differ from the previous one, re-reading an
+  // entry that hasn't changed says nothing about tearing
+  uint64_t reads = 0, accepted = 0, inconsistent = 0;
+  RTSSReader::EntrySnapshot previous = {};
+  auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 1000; i++) {
+      RTSSReader::EntrySnapshot snapshot;
+      reads++;
+      if (!RTSSReader::readSnapshot(snapshot)) {
+        continue;
+      }
+      if (snapshot.frames == previous.frames && snapshot.time0 == previous.time0 &&
+          snapshot.time1 == previous.time1 && snapshot.frameTime == previous.frameTime) {
+        continue;
+      }
+      previous = snapshot;
+      accepted++;
+      uint32_t n = snapshot.frames;
+      if (snapshot.time1 != n || snapshot.frameTime != n || snapshot.time0 != n ||
+          snapshot.statFramerateAvg != n || snapshot.osdFrame != n) {
+        inconsistent++;
+      }
+    }
+  }
+  running = false;
+  writer.join();
+  removeSegment();
+
+  printf("reads %llu, new snapshots %llu, inconsistent accepted %llu, retries %llu, torn %llu\n",
+         (unsigned long long)reads, (unsigned long long)accepted,
+         (unsigned long long)inconsistent, (unsigned long long)RTSSReader::snapshotRetries,
+         (unsigned long long)RTSSReader::tornReads);
+  return inconsistent == 0 ? 0 : 1;
+}
+
+int capture(const char *process, const char *path, double seconds) {
+  RTSSReader::targetProcess = process;
+  if (!RTSSReader::openSharedMemory()) {
+    fprintf(stderr, "Could not open shared memory. Is fakertss write running?\n");
+    return 1;
+  }
+  if (!RTSSReader::startCapture(path)) {
+    perror(path);
+    return 1;
+  }
+  // The engine polls just like main does, so the capture sees what it sees
+  FrameSource::RTSSSource source;
+  FrameSource::Engine *engine;
+  auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+  FrameSource::Engine capturer(
+      source, [](const FrameSource::Frame &) {},
+      [&]() {
+        if (std::chrono::steady_clock::now() >= end) {
+          engine->stop();
+        }
+        return true;
+      });
+  engine = &capturer;
+  capturer.run();
+  RTSSReader::stopCapture();
+  printf("%llu frames seen, %llu missed\n", (unsigned long long)capturer.framesSeen,
+         (unsigned long long)capturer.framesMissed);
+  return 0;
+}
+
+int replay(const char *path, double speed, uint32_t processId) {
+  Capture::Reader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "%s isn't a capture file\n", path);
+    return 1;
+  }
+
+  // Every record of the instance one after the other is what a poller that
+  // never misses anything would have seen
+  FrameSource::ReplaySource source(reader.records, reader.count, speed, processId);
+  FrameSource::FrameDetector detector;
+  FrameSource::Frame frame;
+  uint64_t expected = 0;
+  size_t replayed = 0;
+  for (size_t i = 0; i < reader.count; i++) {
+    if (reader.records[i].processId != source.processId()) {
+      continue;
+    }
+    replayed++;
+    if (detector.update(reader.records[i].snapshot(), frame)) {
+      expected += frame.advanced;
+    }
+  }
+
+  FrameSource::Engine *engine;
+  FrameSource::Engine replayer(
+      source, [](const FrameSource::Frame &) {},
+      [&]() {
+        if (source.finished()) {
+          engine->stop();
+        }
+        return true;
+      });
+  engine = &replayer;
+  double cpuBefore = cpuMs();
+  auto start = std::chrono::steady_clock::now();
+  replayer.run();
+  double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("process %u: %zu of %zu records, %llu frames in the capture, %llu seen, %llu missed, "
+         "%.1fms, cpu %.1f%%\n",
+         source.processId(), replayed, reader.count, (unsigned long long)expected, (unsigned long long)replayer.framesSeen,
+         (unsigned long long)replayer.framesMissed, wall, (cpuMs() - cpuBefore) * 100.0 / wall);
+  return 0;
+}
+} // namespace FakeRTSS
+
+int main(int argc, char **argv) {
+  if (argc >= 4 && strcmp(argv[1], "write") == 0) {
+    return FakeRTSS::write(argv[2], atof(argv[3]), argc >= 5 ? atoi(argv[4]) : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "watch") == 0) {
+    return FakeRTSS::watch(argv[2], argc >= 4 && strcmp(argv[3], "executor") == 0,
+                           argc >= 5 ? argv[4] : nullptr);
+  }
+  if (argc >= 3 && strcmp(argv[1], "hammer") == 0) {
+    return FakeRTSS::hammer(atof(argv[2]));
+  }
+  if (argc >= 5 && strcmp(argv[1], "capture") == 0) {
+    return FakeRTSS::capture(argv[2], argv[3], atof(argv[4]));
+  }
+  if (argc >= 3 && strcmp(argv[1], "replay") == 0) {
+    return FakeRTSS::replay(argv[2], argc >= 4 ? atof(argv[3]) : 1,
+                            argc >= 5 ? strtoul(argv[4], nullptr, 10) : 0);
+  }
+  if (argc >= 2 && strcmp(argv[1], "find") == 0) {
+    return FakeRTSS::find(std::vector<std::string_view>(argv + 2, argv + argc));
+  }
+  fprintf(stderr, "usage: fakertss write <process> <fps> [instances]\n"
+                  "       fakertss watch <process> [inline|executor] [trace file]\n"
+                  "       fakertss hammer <seconds>\n"
+                  "       fakertss capture <process> <file> <seconds>\n"
+                  "       fakertss replay <file> [speed] [pid]\n"
+                  "       fakertss find [process...]\n");
+  return 1;
+}
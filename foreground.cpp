@@ -0,0 +1,86 @@
+#include "foreground.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#endif
+
+namespace Foreground {
+
+#ifdef _WIN32
+Window WindowsProvider::foregroundWindow() {
+  return reinterpret_cast<Window>(GetForegroundWindow());
+}
+
+bool WindowsProvider::processName(Window window, std::string &name, uint32_t &processId) {
+  if (window == 0) {
+    return false;
+  }
+
+  DWORD windowProcessId;
+  GetWindowThreadProcessId(reinterpret_cast<HWND>(window), &windowProcessId);
+
+  // Limited information is all QueryFullProcessImageName needs and also works
+  // on elevated processes
+  HANDLE processHandle =
+      OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, windowProcessId);
+  if (processHandle == NULL) {
+    return false;
+  }
+
+  char processPath[MAX_PATH];
+  DWORD length = MAX_PATH;
+  BOOL ok = QueryFullProcessImageNameA(processHandle, 0, processPath, &length);
+  CloseHandle(processHandle);
+  if (!ok) {
+    return false;
+  }
+
+  // To get just the executable name from the full path
+  char *fileName = processPath;
+  for (DWORD i = 0; i < length; i++) {
+    if (processPath[i] == '\\') {
+      fileName = processPath + i + 1;
+    }
+  }
+  name.assign(fileName, processPath + length);
+  processId = windowProcessId;
+  return true;
+}
+#endif
+
+void Tracker::setTarget(const std::string &process) {
+  target = process;
+  hasCachedWindow = false;
+  targetFocused = false;
+  focusedProcessId = 0;
+}
+
+void Tracker::resolve(Window window) {
+  cachedWindow = window;
+  hasCachedWindow = true;
+  uint32_t processId = 0;
+  bool focused = provider.processName(window, nameBuffer, processId) && nameBuffer == target;
+  targetFocused.store(focused, std::memory_order_relaxed);
+  focusedProcessId.store(focused ? processId : 0, std::memory_order_relaxed);
+}
+
+bool Tracker::isTargetFocused() {
+  Window window = provider.foregroundWindow();
+  if (hasCachedWindow && window == cachedWindow) {
+    hits++;
+  } else {
+    misses++;
+    resolve(window);
+  }
+  return targetFocused.load(std::memory_order_relaxed);
+}
+
+void Tracker::onForegroundChanged(Window window) {
+  if (!hasCachedWindow || window != cachedWindow) {
+    resolve(window);
+  }
+}
+} // namespace Foreground
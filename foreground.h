@@ -0,0 +1,88 @@
+#ifndef FOREGROUND_H
+#define FOREGROUND_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Whether the game is the focused window, for the keyboard hook. Looking up
+// the process behind a window means opening it and reading its image name, so
+// that only happens when the foreground window actually changes.
+namespace Foreground {
+using Window = uintptr_t;
+
+class Provider {
+public:
+  virtual ~Provider() = default;
+  // Has to be cheap, it's called on every bound key event
+  virtual Window foregroundWindow() = 0;
+  // Executable name (no path) and ID of the process owning window, false if
+  // it can't be found out
+  virtual bool processName(Window window, std::string &name, uint32_t &processId) = 0;
+};
+
+#ifdef _WIN32
+// GetForegroundWindow, QueryFullProcessImageName for the name
+class WindowsProvider : public Provider {
+public:
+  Window foregroundWindow() override;
+  bool processName(Window window, std::string &name, uint32_t &processId) override;
+};
+#endif
+
+// For running the tracker without a desktop
+class FakeProvider : public Provider {
+public:
+  Window foregroundWindow() override { return foreground; }
+  bool processName(Window window, std::string &name, uint32_t &processId) override {
+    lookups++;
+    auto it = processNames.find(window);
+    if (it == processNames.end()) {
+      return false;
+    }
+    name = it->second;
+    processId = (uint32_t)window; // one process per window is enough here
+    return true;
+  }
+
+  Window foreground = 0;
+  std::unordered_map<Window, std::string> processNames;
+  uint64_t lookups = 0;
+};
+
+class Tracker {
+public:
+  Tracker(Provider &provider) : provider(provider) {}
+
+  void setTarget(const std::string &process);
+
+  // Compares the foreground window with the one we resolved last time and
+  // only does the expensive lookup when it differs
+  bool isTargetFocused();
+
+  // From a foreground change notification (EVENT_SYSTEM_FOREGROUND on
+  // Windows), resolves right away so the next key event is a cache hit
+  void onForegroundChanged(Window window);
+
+  // Last known answer, readable from any thread
+  std::atomic<bool> targetFocused = false;
+  // Which instance of the target is focused, 0 if none is. For the frame
+  // thread to follow the focused instance's frames.
+  std::atomic<uint32_t> focusedProcessId = 0;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+private:
+  void resolve(Window window);
+
+  Provider &provider;
+  std::string target;
+  Window cachedWindow = 0;
+  bool hasCachedWindow = false;
+  std::string nameBuffer; // reused so resolving doesn't allocate after warm up
+};
+} // namespace Foreground
+
+#endif
@@ -0,0 +1,223 @@
+#include "framegen.h"
+#include <algorithm>
+#include <cmath>
+
+namespace FrameGen {
+
+// Below this share of explained variance the intervals are just noise
+constexpr double cadenceThreshold = 0.5;
+
+const char *sourceName(Source source) {
+  switch (source) {
+  case Source::None:
+    return "none";
+  case Source::Forced:
+    return "forced";
+  case Source::Cadence:
+    return "cadence";
+  case Source::Counter:
+    return "counter";
+  case Source::RateRatio:
+    return "rate ratio";
+  }
+  return "?";
+}
+
+void Detector::reset() {
+  int keepForced = forced;
+  *this = Detector();
+  forced = keepForced;
+}
+
+bool Detector::onFrame(const FrameSource::Frame &frame) {
+  current.frames++;
+  // A skipped present would put two intervals into one, leave those out
+  if (hasLast && frame.advanced == 1) {
+    intervals[next] =
+        std::chrono::duration<double, std::milli>(frame.detectedAt - lastDetectedAt).count();
+    frametimes[next] = frame.frametime;
+    for (int m = 2; m <= maxMultiplier; m++) {
+      phases[m][next] = frame.index % m;
+    }
+    counterSteps[next] = frame.osdFrame != lastOsdFrame;
+    next = (next + 1) % window;
+    if (filled < window) {
+      filled++;
+    }
+  }
+  hasLast = true;
+  lastDetectedAt = frame.detectedAt;
+  lastOsdFrame = frame.osdFrame;
+
+  if (forced > 0 && current.multiplier != forced) {
+    current.multiplier = forced;
+    current.realPhase = 0;
+    current.source = Source::Forced;
+    current.multiplierChanges++;
+  }
+  if (filled >= window / 2 && current.frames % analyzeEvery == 0) {
+    analyze();
+  }
+
+  bool real = current.multiplier <= 1 ||
+              frame.index % current.multiplier == (uint64_t)current.realPhase;
+  if (real) {
+    current.realFrames++;
+  }
+  return real;
+}
+
+void Detector::analyze() {
+  // Cadence: share of the interval variance explained by index % m
+  double mean = 0;
+  for (int i = 0; i < filled; i++) {
+    mean += intervals[i];
+  }
+  mean /= filled;
+  double total = 0;
+  for (int i = 0; i < filled; i++) {
+    total += (intervals[i] - mean) * (intervals[i] - mean);
+  }
+
+  int cadenceMultiplier = 0;
+  int cadencePhase = 0;
+  double bestScore = 0;
+  int phaseOf[maxMultiplier + 1] = {};
+  for (int m = 2; m <= maxMultiplier; m++) {
+    double sums[maxMultiplier] = {};
+    int counts[maxMultiplier] = {};
+    for (int i = 0; i < filled; i++) {
+      sums[phases[m][i]] += intervals[i];
+      counts[phases[m][i]]++;
+    }
+    double between = 0;
+    int longest = 0;
+    for (int p = 0; p < m; p++) {
+      if (counts[p] == 0) {
+        continue;
+      }
+      double phaseMean = sums[p] / counts[p];
+      between += counts[p] * (phaseMean - mean) * (phaseMean - mean);
+      if (phaseMean > sums[longest] / (counts[longest] ? counts[longest] : 1)) {
+        longest = p;
+      }
+    }
+    double score = total > 0 ? between / total : 0;
+    // A flat frame cap still varies by a few ns from rounding, and that can
+    // repeat too. Real frame generation pacing is way off from that.
+    if (std::sqrt(total / filled) < mean * 0.01) {
+      score = 0;
+    }
+    current.cadenceScore[m] = score;
+    phaseOf[m] = longest;
+    bestScore = std::max(bestScore, score);
+  }
+  // A period of 2 also repeats every 4 frames, take the smallest m that
+  // explains about as much as the best one
+  for (int m = 2; m <= maxMultiplier; m++) {
+    if (current.cadenceScore[m] >= cadenceThreshold &&
+        current.cadenceScore[m] >= bestScore - 0.05) {
+      cadenceMultiplier = m;
+      cadencePhase = phaseOf[m];
+      break;
+    }
+  }
+
+  // Field 332 as a generated frames counter
+  int steps = 0;
+  for (int i = 0; i < filled; i++) {
+    steps += counterSteps[i];
+  }
+  double stepShare = double(steps) / filled;
+  int counterMultiplier = 0;
+  int counterPhase = 0;
+  double counterConfidence = 0;
+  for (int m = 2; m <= maxMultiplier; m++) {
+    if (std::abs(stepShare - double(m - 1) / m) < 0.04) {
+      // Rendered presents are the ones that didn't bump it
+      int quiet[maxMultiplier] = {};
+      for (int i = 0; i < filled; i++) {
+        quiet[phases[m][i]] += !counterSteps[i];
+      }
+      for (int p = 1; p < m; p++) {
+        if (quiet[p] > quiet[counterPhase]) {
+          counterPhase = p;
+        }
+      }
+      int consistent = 0;
+      for (int i = 0; i < filled; i++) {
+        bool realPhase = phases[m][i] == counterPhase;
+        consistent += realPhase != counterSteps[i];
+      }
+      counterMultiplier = m;
+      counterConfidence = double(consistent) / filled;
+      break;
+    }
+  }
+  current.counterMultiplier = counterConfidence >= 0.9 ? counterMultiplier : 0;
+
+  // Reported frametime against the present interval
+  double frametimeSum = 0;
+  for (int i = 0; i < filled; i++) {
+    frametimeSum += frametimes[i];
+  }
+  current.rateRatio = mean > 0 ? frametimeSum / filled / mean : 0;
+  int ratioMultiplier = (int)std::lround(current.rateRatio);
+  double ratioError = std::abs(current.rateRatio - ratioMultiplier);
+
+  int multiplier = 1;
+  int phase = 0;
+  double confidence = 1 - bestScore; // how sure we are there's nothing
+  Source source = Source::None;
+  if (forced > 0) {
+    multiplier = forced;
+    source = Source::Forced;
+    confidence = 0;
+    if (forced > 1 && current.cadenceScore[forced] >= cadenceThreshold) {
+      phase = phaseOf[forced];
+      confidence = current.cadenceScore[forced];
+    } else if (forced > 1 && current.counterMultiplier == forced) {
+      phase = counterPhase;
+      confidence = counterConfidence;
+    } else {
+      phase = current.realPhase; // nothing better, keep what we had
+    }
+  } else if (cadenceMultiplier != 0) {
+    multiplier = cadenceMultiplier;
+    phase = cadencePhase;
+    confidence = current.cadenceScore[multiplier];
+    source = Source::Cadence;
+  } else if (current.counterMultiplier != 0) {
+    multiplier = counterMultiplier;
+    phase = counterPhase;
+    confidence = counterConfidence;
+    source = Source::Counter;
+  } else if (ratioMultiplier >= 2 && ratioMultiplier <= maxMultiplier && ratioError < 0.1) {
+    // Right multiplier, but any phase is a guess
+    multiplier = ratioMultiplier;
+    phase = current.multiplier == multiplier ? current.realPhase : 0;
+    confidence = (1 - ratioError / 0.1) * 0.5;
+    source = Source::RateRatio;
+  }
+  current.confidence = confidence;
+
+  if (multiplier == current.multiplier && phase == current.realPhase) {
+    current.source = source;
+    candidateFrames = 0;
+    return;
+  }
+  if (multiplier != candidateMultiplier || phase != candidatePhase) {
+    candidateMultiplier = multiplier;
+    candidatePhase = phase;
+    candidateFrames = 0;
+  }
+  candidateFrames += analyzeEvery;
+  if (candidateFrames >= window / 4) {
+    current.multiplier = multiplier;
+    current.realPhase = phase;
+    current.source = source;
+    current.multiplierChanges++;
+    candidateFrames = 0;
+  }
+}
+} // namespace FrameGen
@@ -0,0 +1,83 @@
+#ifndef FRAMEGEN_H
+#define FRAMEGEN_H
+
+#include "framesource.h"
+#include <cstdint>
+
+// With frame generation RTSS counts generated frames as presents too, and an
+// input sent on a generated frame lands in the middle of a real one. This
+// works out which presents are rendered so tasks only run on those. Nothing
+// tells us directly, so three things are looked at:
+//  - cadence: generated frames are paced in between rendered ones, so over a
+//    window the present intervals repeat with a period of the multiplier.
+//    The rendered frame is taken to be the one after the longest interval,
+//    it's the one that had to wait for the GPU.
+//  - the app entry field at 332 (osdFrame), which older builds of this tool
+//    read as a frames generated counter. Only trusted if it really behaves
+//    like one, going up on a steady (m-1)/m of the presents.
+//  - reported frametime against how often presents actually show up. Some
+//    games report their render frametime, which is then m times the interval.
+namespace FrameGen {
+constexpr int maxMultiplier = 4;
+
+enum class Source : uint8_t { None, Forced, Cadence, Counter, RateRatio };
+
+struct Stats {
+  int multiplier = 1;    // what tasks are scheduled with
+  int realPhase = 0;     // frame.index % multiplier of rendered frames
+  double confidence = 0; // 0..1, for the multiplier and phase in use
+  Source source = Source::None;
+
+  double cadenceScore[maxMultiplier + 1] = {}; // how much of the interval variance repeats with period m
+  int counterMultiplier = 0;                   // 0 if field 332 doesn't look like a counter
+  double rateRatio = 0;                        // reported frametime / observed present interval
+
+  uint64_t frames = 0;
+  uint64_t realFrames = 0;
+  uint64_t multiplierChanges = 0;
+};
+
+class Detector {
+public:
+  static constexpr int window = 96; // divisible by every multiplier
+  // Going over the whole window costs about a microsecond, and the answer
+  // can't change much in a few frames anyway
+  static constexpr int analyzeEvery = 8;
+
+  // Skips detection of the multiplier, the phase is still worked out from
+  // the cadence if it can be. 0 goes back to detecting.
+  void setForced(int multiplier) { forced = multiplier; }
+
+  // Call for every frame. True if it's a rendered one tasks should run on.
+  bool onFrame(const FrameSource::Frame &frame);
+  void reset();
+
+  const Stats &stats() const { return current; }
+
+private:
+  void analyze();
+
+  int forced = 0;
+  Stats current;
+
+  double intervals[window] = {};    // ms between presents
+  double frametimes[window] = {};   // ms as reported
+  uint8_t phases[maxMultiplier + 1][window] = {}; // frame.index % m, worked out once per frame
+  bool counterSteps[window] = {};   // field 332 went up on this present
+  int filled = 0;
+  int next = 0;
+
+  bool hasLast = false;
+  FrameSource::Clock::time_point lastDetectedAt;
+  uint32_t lastOsdFrame = 0;
+
+  // A new estimate has to hold for a while before it's used
+  int candidateMultiplier = 1;
+  int candidatePhase = 0;
+  int candidateFrames = 0;
+};
+
+const char *sourceName(Source source);
+} // namespace FrameGen
+
+#endif
@@ -0,0 +1,68 @@
+#include "framepredictor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace FramePredictor {
+
+static double toMs(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static Clock::duration fromMs(double ms) {
+  return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+Clock::time_point Model::boundary(uint64_t n) const {
+  return anchor + fromMs(period * n);
+}
+
+void Model::onFrame(Clock::time_point detectedAt, uint64_t periods) {
+  if (!primed) {
+    primed = true;
+    anchor = lastDetected = detectedAt;
+    return;
+  }
+  if (periods == 0) {
+    periods = 1;
+  }
+  // Poll latency cancels out between two detections, the period comes from
+  // those. Only the phase has to deal with it.
+  double interval = toMs(detectedAt - lastDetected) / periods;
+  lastDetected = detectedAt;
+  if (period == 0) {
+    period = interval;
+    anchor = detectedAt;
+    return;
+  }
+
+  double residual = toMs(detectedAt - boundary(periods));
+  if (std::abs(residual) > period * 0.5) {
+    // Hitch or a different frame cap. Off twice in a row means the rate
+    // really changed, otherwise keep the period and just line up again.
+    if (settled == 0) {
+      period = interval;
+    }
+    anchor = detectedAt;
+    spread = 0;
+    settled = 0;
+    resyncs++;
+    return;
+  }
+
+  period += (interval - period) * 0.05;
+  // The worst miss while settling, after that up fast and down slow so it
+  // sits above nearly all of them
+  double miss = std::abs(residual);
+  if (settled < settleFrames) {
+    spread = std::max(spread, miss);
+  } else {
+    spread += (miss - spread) * (miss > spread ? 0.5 : 0.01);
+  }
+  // Early detections are the closest to the real present, follow those fast
+  // and late ones only a little. Settles around the quickest quarter of polls.
+  anchor = boundary(periods) + fromMs(residual * (residual < 0 ? 0.5 : 0.05));
+  if (settled < settleFrames) {
+    settled++;
+  }
+}
+} // namespace FramePredictor
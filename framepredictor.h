@@ -0,0 +1,49 @@
+#ifndef FRAMEPREDICTOR_H
+#define FRAMEPREDICTOR_H
+
+#include "framesource.h"
+#include <cstdint>
+
+// Guesses when the next frame gets presented so steps can be sent at a fixed
+// point into it instead of whenever the polling loop happens to notice it.
+// Detections are always a bit late, by however long the poll took, so the
+// model follows the earliest ones and treats the rest as noise. If frames
+// stop lining up with the prediction it says so and the scheduler goes back
+// to running steps on detection.
+namespace FramePredictor {
+using Clock = FrameSource::Clock;
+
+class Model {
+public:
+  static constexpr int settleFrames = 16; // frames in a row that have to line up
+
+  // Call for every frame steps run on. periods is how many of those since
+  // the last call, more than 1 if some were missed.
+  void onFrame(Clock::time_point detectedAt, uint64_t periods = 1);
+  void reset() { *this = Model(); }
+
+  // Whether nearly every frame lands within toleranceMs of the prediction.
+  // Poll latency and frames really being late look the same from here, so
+  // this is on the safe side.
+  bool stable(double toleranceMs) const {
+    return settled >= settleFrames && spread < toleranceMs;
+  }
+  // Predicted present of the frame n frames after the last one
+  Clock::time_point boundary(uint64_t n) const;
+
+  double periodMs() const { return period; }
+  double spreadMs() const { return spread; }
+
+  uint64_t resyncs = 0; // times a frame was too far off and it started over
+
+private:
+  bool primed = false;
+  Clock::time_point anchor; // where we think the last frame was presented
+  Clock::time_point lastDetected;
+  double period = 0; // ms
+  double spread = 0; // ms, how far off nearly all predictions are
+  int settled = 0;
+};
+} // namespace FramePredictor
+
+#endif
@@ -0,0 +1,265 @@
+#include "framesource.h"
+#include "rtssreader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_PAUSE() _mm_pause()
+#else
+#define CPU_PAUSE() std::this_thread::yield()
+#endif
+
+using namespace std::chrono_literals;
+
+namespace FrameSource {
+
+bool FrameDetector::update(const RTSSReader::EntrySnapshot &snapshot, Frame &frame) {
+  uint32_t time0 = snapshot.time0;
+  uint32_t frames = snapshot.frames;
+
+  // A restarted game gets a fresh entry, its counters mean nothing to us
+  if (!primed || snapshot.processId != processId) {
+    primed = true;
+    processId = snapshot.processId;
+    lastTime0 = time0;
+    lastFrames = frames;
+    return false;
+  }
+  if (time0 == lastTime0 && frames == lastFrames) {
+    return false;
+  }
+
+  uint32_t advanced;
+  if (time0 == lastTime0 && frames > lastFrames) {
+    advanced = frames - lastFrames;
+  } else {
+    // New period. The frame that rolled it over was counted in the old one,
+    // so this is a lower bound if we missed the end of the last period.
+    advanced = frames + 1;
+  }
+  lastTime0 = time0;
+  lastFrames = frames;
+  index += advanced;
+
+  frame.index = index;
+  frame.advanced = advanced;
+  frame.frametime = snapshot.frametimeMs();
+  frame.osdFrame = snapshot.osdFrame;
+  return true;
+}
+
+RTSSSource::InstanceClock *RTSSSource::clockFor(uint32_t processId) {
+  InstanceClock *free = nullptr;
+  for (InstanceClock &clock : instances) {
+    if (clock.processId == processId) {
+      return &clock;
+    }
+    if (free == nullptr && clock.processId == 0) {
+      free = &clock;
+    }
+  }
+  if (free != nullptr) {
+    *free = {};
+    free->processId = processId;
+  }
+  return free;
+}
+
+void RTSSSource::reset() {
+  for (InstanceClock &clock : instances) {
+    clock = {};
+  }
+  active = 0;
+  switched = false;
+}
+
+bool RTSSSource::poll(Frame &frame) {
+  RTSSReader::EntrySnapshot snapshots[RTSSReader::maxInstances];
+  int count = RTSSReader::readSnapshots(snapshots, RTSSReader::maxInstances);
+  if (count == 0) {
+    // Nothing readable this time, RTSS kept writing or is setting up. The clocks
+    // keep their place, a game that's really gone frees its clock on the
+    // next poll that reads anything.
+    return false;
+  }
+
+  // Instances that went away free their clock
+  for (InstanceClock &clock : instances) {
+    clock.seen = false;
+  }
+  for (int i = 0; i < count; i++) {
+    if (InstanceClock *clock = clockFor(snapshots[i].processId)) {
+      clock->seen = true;
+    }
+  }
+  uint32_t focused = focusedProcessId != nullptr
+                         ? focusedProcessId->load(std::memory_order_relaxed)
+                         : 0;
+  uint32_t wanted = snapshots[0].processId;
+  for (InstanceClock &clock : instances) {
+    if (!clock.seen) {
+      clock = {};
+    } else if (clock.processId == focused || (clock.processId == active && focused == 0)) {
+      // Focus elsewhere keeps whichever one we had
+      wanted = clock.processId;
+    }
+  }
+  if (wanted != active) {
+    if (active != 0) {
+      switches++;
+    }
+    active = wanted;
+    switched = true;
+  }
+
+  bool detected = false;
+  Clock::time_point now = Clock::now();
+  for (int i = 0; i < count; i++) {
+    InstanceClock *clock = clockFor(snapshots[i].processId);
+    Frame instanceFrame;
+    if (clock == nullptr || !clock->detector.update(snapshots[i], instanceFrame)) {
+      continue;
+    }
+    clock->frames += instanceFrame.advanced;
+    clock->frametime = instanceFrame.frametime;
+    if (clock->processId == active) {
+      // Frames the previous instance had coming don't count as missed
+      uint32_t advanced = switched ? 1 : instanceFrame.advanced;
+      switched = false;
+      index += advanced;
+      frame = instanceFrame;
+      frame.index = index;
+      frame.advanced = advanced;
+      frame.detectedAt = now;
+      detected = true;
+    }
+  }
+  return detected;
+}
+
+void ReplaySource::reset() {
+  next = 0;
+  started = false;
+  detector.reset();
+}
+
+bool ReplaySource::poll(Frame &frame) {
+  Clock::time_point now = Clock::now();
+  if (!started) {
+    started = true;
+    start = now;
+  }
+  int64_t replayNs = speed > 0 ? (int64_t)(std::chrono::duration<double, std::nano>(now - start).count() * speed)
+                               : INT64_MAX;
+
+  // Everything that happened since the last poll, a slow poll sees several
+  // records at once just like it would reading the entry live
+  bool detected = false;
+  uint32_t advanced = 0;
+  while (next < count && records[next].timestampNs <= replayNs) {
+    const Capture::Record &record = records[next++];
+    if (record.processId != replayed) {
+      continue; // another instance of the game
+    }
+    if (detector.update(record.snapshot(), frame)) {
+      detected = true;
+      advanced += frame.advanced;
+    }
+    if (speed <= 0 && detected) {
+      break;
+    }
+  }
+  if (!detected) {
+    return false;
+  }
+  frame.advanced = advanced;
+  // The waiter predicts from this, it has to be in replay time
+  frame.frametime = speed > 0 ? frame.frametime / speed : 0;
+  frame.detectedAt = now;
+  return true;
+}
+
+void AdaptiveWaiter::onFrame(Clock::time_point now, double frametime) {
+  lastFrame = now;
+  if (frametime <= 0) {
+    return;
+  }
+  // Frametime from RTSS is far less noisy than our own detection intervals
+  period = period == 0 ? frametime : period + (frametime - period) * 0.125;
+}
+
+void AdaptiveWaiter::timedSleep() {
+  Clock::time_point start = Clock::now();
+#ifdef _WIN32
+  Sleep(1);
+#else
+  std::this_thread::sleep_for(1ms);
+#endif
+  double slept = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  sleepOvershoot += (slept - sleepOvershoot) * 0.125;
+  sleeps++;
+}
+
+void AdaptiveWaiter::wait(bool busy, Clock::time_point deadline) {
+  Clock::time_point now = Clock::now();
+  double untilDeadline = deadline == Clock::time_point::max()
+                             ? INFINITY
+                             : std::chrono::duration<double, std::milli>(deadline - now).count();
+  if (untilDeadline <= 0) {
+    return;
+  }
+  // With no period yet (RTSS not attached, game not hooked) there's
+  // nothing to predict from, so only the deadline limits the sleep
+  double remaining = INFINITY;
+  if (busy && period != 0) {
+    double elapsed = std::chrono::duration<double, std::milli>(now - lastFrame).count();
+    remaining = period - elapsed;
+    // Well overdue (hitch, loading screen), a late frame isn't worth
+    // burning the core for
+    if (remaining < -period * 0.25) {
+      remaining = INFINITY;
+    }
+  }
+  remaining = std::min(remaining, untilDeadline);
+
+  if (remaining > sleepOvershoot * 1.5) {
+    timedSleep();
+  } else if (remaining > 0.25) {
+    yields++;
+    std::this_thread::yield();
+  } else {
+    spins++;
+    for (int i = 0; i < 32; i++) {
+      CPU_PAUSE();
+    }
+  }
+}
+
+void Engine::run() {
+  running = true;
+  source.reset();
+  Frame frame;
+  while (running) {
+    if (source.poll(frame)) {
+      framesSeen += frame.advanced;
+      framesMissed += frame.advanced - 1;
+      waiter.onFrame(frame.detectedAt, frame.frametime);
+      onFrame(frame);
+    } else {
+      Clock::time_point deadline =
+          onTick ? onTick(Clock::now()) : Clock::time_point::max();
+      waiter.wait(busy(), deadline);
+    }
+  }
+}
+} // namespace FrameSource
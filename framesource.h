@@ -0,0 +1,166 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include "capture.h"
+#include "rtssreader.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace FrameSource {
+using Clock = std::chrono::steady_clock;
+
+struct Frame {
+  uint64_t index;      // frames seen since the source attached
+  uint32_t advanced;   // frames since the previous Frame, >1 means we missed some
+  double frametime;    // ms, as reported for the latest frame
+  Clock::time_point detectedAt;
+  uint32_t osdFrame = 0; // raw app entry field 332, see framegen.h
+};
+
+// Anything that can tell us a new frame was presented. Frames are detected
+// from a per-frame counter, never from the frametime changing.
+class Source {
+public:
+  virtual ~Source() = default;
+  // Returns true and fills frame if a frame was presented since the last call
+  virtual bool poll(Frame &frame) = 0;
+  // Forget the last seen frame, the next poll only primes the source
+  virtual void reset() = 0;
+};
+
+// Turns successive entry snapshots into frames. RTSS bumps dwFrames on every
+// present and restarts it at 0 together with dwTime0 every framerate period,
+// so (dwTime0, dwFrames) changes once per frame even with a flat FPS cap.
+class FrameDetector {
+public:
+  // True and fills frame (apart from detectedAt) if snapshot is a new frame
+  bool update(const RTSSReader::EntrySnapshot &snapshot, Frame &frame);
+  void reset() { primed = false; }
+
+private:
+  bool primed = false;
+  uint32_t processId = 0;
+  uint32_t lastTime0 = 0;
+  uint32_t lastFrames = 0;
+  uint64_t index = 0;
+};
+
+// Reads every running instance of RTSSReader::targetProcess in one poll,
+// each with a frame clock of its own, and hands out the frames of one of
+// them: the focused one, or the first one RTSS lists if none is. The others'
+// clocks keep running, so switching between instances doesn't lose a frame
+// to priming. Frames handed out keep counting up across switches.
+class RTSSSource : public Source {
+public:
+  struct InstanceClock {
+    uint32_t processId = 0; // 0 for a free one
+    FrameDetector detector;
+    uint64_t frames = 0;
+    double frametime = 0;
+    bool seen = false; // in the last poll
+  };
+
+  // focusedProcessId is the process of the focused window, or 0 if it's
+  // something else. Read once a poll, nullptr always uses the first.
+  explicit RTSSSource(const std::atomic<uint32_t> *focusedProcessId = nullptr)
+      : focusedProcessId(focusedProcessId) {}
+
+  bool poll(Frame &frame) override;
+  void reset() override;
+
+  const InstanceClock *clocks() const { return instances; }
+  uint32_t activeProcessId() const { return active; }
+  uint64_t switches = 0; // times the active instance changed
+
+private:
+  InstanceClock *clockFor(uint32_t processId);
+
+  const std::atomic<uint32_t> *focusedProcessId;
+  InstanceClock instances[RTSSReader::maxInstances];
+  uint32_t active = 0;
+  bool switched = false; // the next frame of the active one is its first
+  uint64_t index = 0;
+};
+
+// Plays a capture (capture.h) back through the same detection. speed 1 is
+// real time, 10 ten times as fast and 0 hands out one record per poll.
+class ReplaySource : public Source {
+public:
+  // Only the records of processId are replayed, 0 for whichever process
+  // the capture starts with
+  ReplaySource(const Capture::Record *records, size_t count, double speed, uint32_t processId = 0)
+      : records(records), count(count), speed(speed),
+        replayed(processId != 0 || count == 0 ? processId : records[0].processId) {}
+
+  bool poll(Frame &frame) override;
+  void reset() override;
+  bool finished() const { return next >= count; }
+  uint32_t processId() const { return replayed; }
+
+private:
+  const Capture::Record *records;
+  size_t count;
+  double speed;
+  uint32_t replayed;
+  size_t next = 0;
+  bool started = false;
+  Clock::time_point start;
+  FrameDetector detector;
+};
+
+// Backoff between polls. Far from the next predicted frame we do a timed
+// sleep, closer in we yield, and right around it we spin with pause. The
+// thresholds come from the measured frame period and how long a sleep
+// actually takes on this machine.
+class AdaptiveWaiter {
+public:
+  void onFrame(Clock::time_point now, double frametime);
+  // One backoff step. busy is false when nothing is queued, then precision
+  // doesn't matter and we always sleep. Returns early enough to hit
+  // deadline if there is one, spinning for the last bit of it.
+  void wait(bool busy, Clock::time_point deadline = Clock::time_point::max());
+  double periodMs() const { return period; }
+
+  uint64_t sleeps = 0;
+  uint64_t yields = 0;
+  uint64_t spins = 0;
+
+private:
+  void timedSleep();
+
+  double period = 0;          // smoothed frame period in ms
+  double sleepOvershoot = 1;  // smoothed actual length of a 1ms sleep
+  Clock::time_point lastFrame;
+};
+
+// Polls a Source and calls onFrame for every new frame. onTick, if given,
+// gets called between polls to run anything that's due and returns when it
+// next needs to be called.
+class Engine {
+public:
+  Engine(Source &source, std::function<void(const Frame &)> onFrame,
+         std::function<bool()> busy,
+         std::function<Clock::time_point(Clock::time_point)> onTick = nullptr)
+      : source(source), onFrame(std::move(onFrame)), busy(std::move(busy)),
+        onTick(std::move(onTick)) {}
+
+  // Runs on the calling thread until stop() is called
+  void run();
+  void stop() { running = false; }
+
+  AdaptiveWaiter waiter;
+  uint64_t framesSeen = 0;
+  uint64_t framesMissed = 0;
+
+private:
+  Source &source;
+  std::function<void(const Frame &)> onFrame;
+  std::function<bool()> busy;
+  std::function<Clock::time_point(Clock::time_point)> onTick;
+  std::atomic<bool> running = true;
+};
+} // namespace FrameSource
+
+#endif
@@ -0,0 +1,108 @@
+#include "framestats.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+namespace FrameStats {
+
+// Under 32µs every microsecond gets a bucket. Above that the top 5 bits
+// pick it, shift * 16 + those bits comes out in order with no gaps.
+int Histogram::bucketOf(double ms) {
+  double us = ms * 1000;
+  uint32_t whole = us <= 0 ? 0 : us >= (1 << 24) ? (1 << 24) - 1 : (uint32_t)us;
+  int shift = std::max(0, (int)std::bit_width(whole) - 5);
+  return shift * subBuckets + (int)(whole >> shift);
+}
+
+double Histogram::upperMs(int bucket) {
+  int shift = bucket < 2 * subBuckets ? 0 : bucket / subBuckets - 1;
+  uint32_t mantissa = bucket - shift * subBuckets;
+  return (double)((mantissa + 1) << shift) / 1000;
+}
+
+// Moves the cursor until its rank falls in its bucket
+void Histogram::follow(Cursor &cursor) {
+  if (total == 0) {
+    cursor.bucket = 0;
+    cursor.below = 0;
+    return;
+  }
+  // 1 based rank of the value the quantile asks for
+  uint32_t rank = std::max<uint32_t>(1, (cursor.perMille * total + 999) / 1000);
+  while (cursor.bucket > 0 && cursor.below >= rank) {
+    cursor.bucket--;
+    cursor.below -= counts[cursor.bucket];
+  }
+  while (cursor.below + counts[cursor.bucket] < rank && cursor.bucket < bucketCount - 1) {
+    cursor.below += counts[cursor.bucket];
+    cursor.bucket++;
+  }
+}
+
+void Histogram::add(int bucket) {
+  counts[bucket]++;
+  total++;
+  top = std::max(top, bucket);
+  for (Cursor &cursor : cursors) {
+    if (bucket < cursor.bucket) {
+      cursor.below++;
+    }
+    follow(cursor);
+  }
+}
+
+void Histogram::remove(int bucket) {
+  counts[bucket]--;
+  total--;
+  while (top > 0 && counts[top] == 0) {
+    top--;
+  }
+  for (Cursor &cursor : cursors) {
+    if (bucket < cursor.bucket) {
+      cursor.below--;
+    }
+    follow(cursor);
+  }
+}
+
+void Tracker::onFrame(const FrameSource::Frame &frame) {
+  double frametime = frame.frametime;
+  if (frametime <= 0 && frames != 0 && frame.advanced != 0) {
+    frametime = std::chrono::duration<double, std::milli>(frame.detectedAt - lastDetected).count() /
+                frame.advanced;
+  }
+  lastDetected = frame.detectedAt;
+  frames++;
+  if (frametime <= 0) {
+    return;
+  }
+  lastFrametime = frametime;
+  maxFrametime = std::max(maxFrametime, frametime);
+
+  // Judged against the window from before this frame, the long one so a
+  // burst of bad frames doesn't become the new normal right away
+  const Histogram &usual = longWindow.stats();
+  double normal = usual.p50();
+  if (usual.count() >= warmupFrames && frametime > normal * hitchFactor &&
+      frametime > normal + hitchMinMs) {
+    sinceHitch = 0;
+    hitches++;
+  } else if (sinceHitch < holdFrames) {
+    sinceHitch++;
+  }
+
+  recentWindow.push(frametime);
+  longWindow.push(frametime);
+}
+
+void Tracker::reset() {
+  recentWindow.reset();
+  longWindow.reset();
+  maxFrametime = 0;
+  lastFrametime = 0;
+  lastDetected = {};
+  sinceHitch = 1 << 30;
+  frames = 0;
+  hitches = 0;
+}
+} // namespace FrameStats
@@ -0,0 +1,170 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "framesource.h"
+#include <algorithm>
+#include <cstdint>
+
+// Frame pacing over the last few seconds, so a macro that went wrong can be
+// told apart from the game hitching. Frametimes go into log buckets, 16 per
+// power of two of microseconds, so any bucket is at most ~6% wide and the
+// whole thing is a fixed size. Percentiles are kept up to date as frames go
+// in and out of the window instead of walking the buckets every time.
+// Nothing on the update path allocates.
+namespace FrameStats {
+class Histogram {
+public:
+  static constexpr int subBuckets = 16;
+  static constexpr int bucketCount = subBuckets * 21; // up to ~16.7s
+
+  static int bucketOf(double ms);
+  static double upperMs(int bucket); // what a bucket reports as
+
+  void add(int bucket);
+  void remove(int bucket);
+  void reset() { *this = Histogram(); }
+
+  uint32_t count() const { return total; }
+  // Upper bound of the bucket each falls in, 0 when empty
+  double p50() const { return valueOf(cursors[0]); }
+  double p95() const { return valueOf(cursors[1]); }
+  double p99() const { return valueOf(cursors[2]); }
+  double max() const { return total == 0 ? 0 : upperMs(top); }
+
+private:
+  // Bucket the rank for quantile falls in, with how many are in the ones
+  // below it. A new frame moves it by a bucket or two at most when frametimes
+  // are anywhere near steady, it only has to walk far after a big hitch.
+  struct Cursor {
+    uint32_t perMille;
+    int bucket = 0;
+    uint32_t below = 0;
+  };
+  void follow(Cursor &cursor);
+  double valueOf(const Cursor &cursor) const { return total == 0 ? 0 : upperMs(cursor.bucket); }
+
+  uint32_t counts[bucketCount] = {};
+  uint32_t total = 0;
+  int top = 0; // highest bucket with anything in it
+  Cursor cursors[3] = {{500}, {950}, {990}};
+};
+
+struct Summary {
+  double p50 = 0, p95 = 0, p99 = 0, max = 0; // ms
+  uint32_t frames = 0;
+};
+
+// Largest (Largest) or smallest of the last Frames values pushed. A value
+// that a newer one beats can never be the answer again and is dropped right
+// away, so each value goes in and out once and a push is amortized O(1) even
+// when every frametime is the same.
+template <uint32_t Frames, bool Largest> class RunningExtreme {
+public:
+  void push(float value) {
+    if (count != 0 && pushed - entries[head].pushed >= Frames) {
+      head = (head + 1) % Frames; // left the window
+      count--;
+    }
+    while (count != 0 && !beats(entries[(head + count - 1) % Frames].value, value)) {
+      count--;
+    }
+    entries[(head + count) % Frames] = {pushed++, value};
+    count++;
+  }
+  float value() const { return count == 0 ? 0 : entries[head].value; }
+
+private:
+  static bool beats(float kept, float value) { return Largest ? kept > value : kept < value; }
+
+  struct Entry {
+    uint32_t pushed; // which push it came from, wraps around fine
+    float value;
+  };
+  Entry entries[Frames];
+  uint32_t head = 0;
+  uint32_t count = 0;
+  uint32_t pushed = 0;
+};
+
+// Histogram of the last Frames frametimes, plus their exact smallest and
+// largest
+template <uint32_t Frames> class Window {
+public:
+  void push(double ms) {
+    float value = (float)ms;
+    if (filled == Frames) {
+      histogram.remove(ring[next]);
+    } else {
+      filled++;
+    }
+    ring[next] = Histogram::bucketOf(value);
+    histogram.add(ring[next]);
+    next = next + 1 == Frames ? 0 : next + 1;
+    lowest.push(value);
+    highest.push(value);
+  }
+  void reset() { *this = Window(); }
+  const Histogram &stats() const { return histogram; }
+
+  // Percentiles come out as the upper bound of their bucket, clamped to what
+  // was actually seen so none of them is over the max
+  Summary summary() const {
+    double low = lowest.value(), high = highest.value();
+    auto seen = [&](double ms) { return std::clamp(ms, low, high); };
+    return {seen(histogram.p50()), seen(histogram.p95()), seen(histogram.p99()), high,
+            histogram.count()};
+  }
+
+private:
+  Histogram histogram;
+  uint16_t ring[Frames];
+  uint32_t next = 0;
+  uint32_t filled = 0;
+  RunningExtreme<Frames, false> lowest;
+  RunningExtreme<Frames, true> highest;
+};
+
+class Tracker {
+public:
+  static constexpr uint32_t recentFrames = 128; // ~1s at 120fps
+  static constexpr uint32_t longFrames = 1024;
+  // Frames the long window needs before anything counts as a hitch
+  static constexpr uint32_t warmupFrames = 60;
+
+  // A hitch is a frame over hitchFactor times the usual frametime and at
+  // least hitchMinMs over it, so a 240fps game dropping a frame doesn't count.
+  // The usual frametime is the long window's p50 bucket bound, which is up to
+  // ~6% over the real median, so the threshold really is 2-2.125x.
+  double hitchFactor = 2.0;
+  double hitchMinMs = 4.0;
+  // Frames after a hitch, including it, holding() stays true for. Games tend
+  // to catch up with a couple of short frames right after one.
+  int holdFrames = 2;
+
+  // Call for every present. Uses the reported frametime, or the time since
+  // the last frame if the source doesn't give one.
+  void onFrame(const FrameSource::Frame &frame);
+  void reset();
+
+  bool hitch() const { return sinceHitch == 0; } // the last frame was one
+  bool holding() const { return sinceHitch < holdFrames; }
+
+  Summary recent() const { return recentWindow.summary(); }
+  Summary overall() const { return longWindow.summary(); }
+  double maxMs() const { return maxFrametime; } // since reset, exact
+  double lastMs() const { return lastFrametime; }
+
+  uint64_t frames = 0;
+  uint64_t hitches = 0;
+
+private:
+  Window<recentFrames> recentWindow;
+  Window<longFrames> longWindow;
+  double maxFrametime = 0;
+  double lastFrametime = 0;
+  FrameSource::Clock::time_point lastDetected;
+  int sinceHitch = 1 << 30;
+};
+} // namespace FrameStats
+
+#endif
@@ -0,0 +1,138 @@
+#include "hookdispatch.h"
+#include "keymap.h"
+#include <algorithm>
+#include <chrono>
+
+namespace HookDispatch {
+
+KeyMask modifierMask(uint16_t vkCode) {
+  KeyMask mask;
+  if (vkCode > 0xFF) {
+    return mask; // wheel pseudo keys can't be held
+  }
+  mask.set(vkCode);
+  switch (vkCode) {
+  case VK_SHIFT:
+    mask.set(VK_LSHIFT);
+    mask.set(VK_RSHIFT);
+    break;
+  case VK_CONTROL:
+    mask.set(VK_LCONTROL);
+    mask.set(VK_RCONTROL);
+    break;
+  case VK_MENU:
+    mask.set(VK_LMENU);
+    mask.set(VK_RMENU);
+    break;
+  }
+  return mask;
+}
+
+bool Dispatcher::add(uint16_t vkCode, const std::vector<uint16_t> &modifiers,
+                     std::function<void()> function) {
+  if (vkCode > 0xFF || modifiers.size() > Binding::maxModifiers) {
+    return false;
+  }
+  Binding binding = {(uint8_t)vkCode, (uint8_t)modifiers.size(), false, {}, std::move(function)};
+  for (size_t i = 0; i < modifiers.size(); i++) {
+    binding.modifiers[i] = modifierMask(modifiers[i]);
+  }
+
+  // Keep registration order within a vk code, earlier keybinds win like they
+  // did when the hook walked the whole list
+  auto position = std::upper_bound(
+      bindings.begin(), bindings.end(), vkCode,
+      [](uint16_t vk, const Binding &other) { return vk < other.vkCode; });
+  bindings.insert(position, std::move(binding));
+
+  buckets = {};
+  for (size_t i = 0; i < bindings.size(); i++) {
+    Bucket &bucket = buckets[bindings[i].vkCode];
+    if (bucket.count == 0) {
+      bucket.first = i;
+    }
+    bucket.count++;
+  }
+  return true;
+}
+
+void Dispatcher::keepPressed(const Dispatcher &previous) {
+  for (Binding &binding : bindings) {
+    Bucket bucket = previous.buckets[binding.vkCode];
+    for (uint16_t i = bucket.first; i < bucket.first + bucket.count; i++) {
+      const Binding &old = previous.bindings[i];
+      if (old.modifierCount == binding.modifierCount &&
+          std::equal(old.modifiers, old.modifiers + old.modifierCount, binding.modifiers)) {
+        binding.isPressed = old.isPressed;
+        break;
+      }
+    }
+  }
+}
+
+bool Dispatcher::onKeyDown(uint8_t vkCode, const KeyState &held) {
+  Bucket bucket = buckets[vkCode];
+  for (uint16_t i = bucket.first; i < bucket.first + bucket.count; i++) {
+    Binding &binding = bindings[i];
+    if (binding.isPressed) {
+      continue; // auto-repeat
+    }
+    bool modifiersPressed = true;
+    for (int m = 0; m < binding.modifierCount; m++) {
+      modifiersPressed &= held.mask().intersects(binding.modifiers[m]);
+    }
+    if (modifiersPressed) {
+      binding.isPressed = true;
+      binding.function();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Dispatcher::onKeyUp(uint8_t vkCode) {
+  Bucket bucket = buckets[vkCode];
+  for (uint16_t i = bucket.first; i < bucket.first + bucket.count; i++) {
+    bindings[i].isPressed = false;
+  }
+  return bucket.count != 0;
+}
+
+bool Router::onKey(const KeySource::Event &event) {
+  // Our own inputs (and other programs') don't count as holding anything
+  if (event.injected) {
+    return false;
+  }
+  keys.set(event.vkCode, event.down);
+
+  // Unbound keys are the common case, don't even look at the foreground
+  // window for those. They aren't timed for telemetry either, that would
+  // cost more than handling them.
+  Dispatcher *dispatcher = current.load(std::memory_order_acquire);
+  if (dispatcher == nullptr || !dispatcher->isBound(event.vkCode)) {
+    return false;
+  }
+  if (telemetry == nullptr) {
+    return dispatch(*dispatcher, event);
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool eaten = dispatch(*dispatcher, event);
+  int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  published.events++;
+  published.eaten += eaten;
+  published.lastDispatchNs = elapsed;
+  published.maxDispatchNs = std::max(published.maxDispatchNs, elapsed);
+  telemetry->publish(published);
+  return eaten;
+}
+
+bool Router::dispatch(Dispatcher &dispatcher, const KeySource::Event &event) {
+  if (!foreground.isTargetFocused()) {
+    return false;
+  }
+  return event.down ? dispatcher.onKeyDown(event.vkCode, keys)
+                    : dispatcher.onKeyUp(event.vkCode);
+}
+} // namespace HookDispatch
@@ -0,0 +1,132 @@
+#ifndef HOOKDISPATCH_H
+#define HOOKDISPATCH_H
+
+#include "foreground.h"
+#include "keysource.h"
+#include "telemetry.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Keybind lookup for the low-level keyboard hook. Windows drops hooks that
+// take too long, so everything that can be worked out up front is: bindings
+// are bucketed by vk code and modifiers are turned into key masks once.
+namespace HookDispatch {
+// One bit per virtual-key code
+struct KeyMask {
+  uint64_t bits[4] = {};
+
+  void set(uint8_t vkCode) { bits[vkCode >> 6] |= 1ull << (vkCode & 63); }
+  void clear(uint8_t vkCode) { bits[vkCode >> 6] &= ~(1ull << (vkCode & 63)); }
+  bool test(uint8_t vkCode) const { return bits[vkCode >> 6] >> (vkCode & 63) & 1; }
+  bool intersects(const KeyMask &other) const {
+    return ((bits[0] & other.bits[0]) | (bits[1] & other.bits[1]) |
+            (bits[2] & other.bits[2]) | (bits[3] & other.bits[3])) != 0;
+  }
+  bool operator==(const KeyMask &other) const = default;
+};
+
+// Keys that count as holding vkCode. The hook only ever sees the left/right
+// variants of shift, ctrl and alt, never the generic codes.
+KeyMask modifierMask(uint16_t vkCode);
+
+// Physical key state, kept outside the dispatcher so it survives swapping in
+// a new set of keybinds.
+class KeyState {
+public:
+  // Called for every physical (not injected) event, focused or not, so
+  // modifier state is right when the game gets focus back. The frame thread
+  // reads it too for held key repeats, so single keys go through atomic_ref.
+  void set(uint8_t vkCode, bool pressed) {
+    std::atomic_ref<uint64_t> word(keys.bits[vkCode >> 6]);
+    uint64_t bit = 1ull << (vkCode & 63);
+    pressed ? word.fetch_or(bit, std::memory_order_relaxed)
+            : word.fetch_and(~bit, std::memory_order_relaxed);
+  }
+  bool get(uint8_t vkCode) const {
+    std::atomic_ref<uint64_t> word(const_cast<uint64_t &>(keys.bits[vkCode >> 6]));
+    return word.load(std::memory_order_relaxed) >> (vkCode & 63) & 1;
+  }
+  // Only for the hook thread, the one that writes it
+  const KeyMask &mask() const { return keys; }
+
+private:
+  KeyMask keys;
+};
+
+struct Binding {
+  static constexpr int maxModifiers = 4;
+
+  uint8_t vkCode;
+  uint8_t modifierCount;
+  bool isPressed;
+  KeyMask modifiers[maxModifiers]; // each one needs any of its keys held
+  std::function<void()> function;
+};
+
+class Dispatcher {
+public:
+  // False if vkCode isn't a keyboard key or there are too many modifiers
+  bool add(uint16_t vkCode, const std::vector<uint16_t> &modifiers,
+           std::function<void()> function);
+
+  // Both return true if the event belongs to a keybind and should be eaten
+  bool onKeyDown(uint8_t vkCode, const KeyState &held);
+  bool onKeyUp(uint8_t vkCode);
+
+  bool isBound(uint8_t vkCode) const { return buckets[vkCode].count != 0; }
+
+  // Bindings with the same key and modifiers stay pressed if they were in
+  // previous, so holding one through a reload doesn't fire it again on
+  // auto-repeat. Reads previous's state, so only from the hook's thread.
+  void keepPressed(const Dispatcher &previous);
+
+private:
+  struct Bucket {
+    uint16_t first = 0;
+    uint16_t count = 0;
+  };
+
+  std::array<Bucket, 256> buckets;
+  std::vector<Binding> bindings; // sorted by vk code, a bucket is a range of it
+};
+// What the hook runs for every event: tracks physical keys, then hands bound
+// keys to the current dispatcher if the game is focused.
+class Router : public KeySource::Handler {
+public:
+  Router(Foreground::Tracker &foreground) : foreground(foreground) {}
+
+  bool onKey(const KeySource::Event &event) override;
+
+  // Swaps in another set of keybinds and returns the old one. Events already
+  // being handled can still be using it, free it from a KeySource post.
+  Dispatcher *swap(Dispatcher *dispatcher) {
+    return current.exchange(dispatcher, std::memory_order_acq_rel);
+  }
+  // swap for a reload, carries over which keybinds are held. Only from a
+  // KeySource post, where nothing else is using the old one and it can be
+  // freed right away.
+  Dispatcher *replace(Dispatcher *dispatcher) {
+    Dispatcher *old = current.load(std::memory_order_relaxed);
+    if (old != nullptr && dispatcher != nullptr) {
+      dispatcher->keepPressed(*old);
+    }
+    return swap(dispatcher);
+  }
+
+  KeyState keys;
+  // Gets how long every event of a bound key took to handle when set
+  Telemetry::Writer *telemetry = nullptr;
+
+private:
+  bool dispatch(Dispatcher &dispatcher, const KeySource::Event &event);
+
+  Foreground::Tracker &foreground;
+  Telemetry::HookBlock published = {};
+  std::atomic<Dispatcher *> current = nullptr;
+};
+} // namespace HookDispatch
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef KEYBINDS_H
+#define KEYBINDS_H
+
+#include "keymap.h"
+#include "macro.h"
+#include <cstdint>
+#include <span>
+
+// The macros builtInKeybinds binds when there is no macros.txt. They live
+// here so the simulator can run the exact same inputs without the Windows side.
+namespace Keybinds {
+struct MacroKeybind {
+  const char *name;
+  uint16_t vkCode;
+  const char *modifier; // nullptr for none
+  std::span<const Macro::Input> inputs;
+  int lane; // see InputHandler::lanes, one macro at a time per lane
+  uint32_t times = 1; // runs this many times in a row, whileHeld until the key is let go
+};
+
+inline constexpr uint32_t whileHeld = 0;
+
+inline constexpr Macro::Input macro220[] = {
+    "mR",       "enter down", "enter up",  "enter downR", "down 4",
+    "enter up", "enter downR", "down down", "enter up",   "down up"};
+
+inline constexpr Macro::Input macroF2[] = {
+    "mR",    "enter down",  "up 7",    "enter up", "enter", "sleep",
+    "enter", "enter downR", "up down", "enter up", "up up", "m"};
+
+inline constexpr Macro::Input macro221[] = {
+    "mR",         "enter down", "up 6",     "enter up",    "down downR",
+    "enter down", "down up",    "enter upR", "sleep 2",    "space downR",
+    "m down",     "m upR",      "space up"};
+
+inline constexpr Macro::Input macro186[] = {
+    "mR",         "enter down", "up 7", "enter up", "down downR",
+    "enter down", "down up",    "down", "enter up"};
+
+// Types hello in chat over and over
+inline constexpr Macro::Input macroF6[] = {
+    "enter downR", "t", "hR", "eR", "lR", "lR", "o", "enter up"};
+
+// You can't type 220 or the others as a string so they're virtual keycodes.
+// These all go through the interaction menu, two of them at once would just
+// fight over it, so they share a lane.
+inline constexpr int menuLane = 0;
+inline constexpr int chatLane = 1;
+inline constexpr MacroKeybind macros[] = {
+    {"220", 220, nullptr, macro220, menuLane},
+    {"F2", KeyMap::vk("F2"), nullptr, macroF2, menuLane},
+    {"shift+221", 221, "shift", macro221, menuLane},
+    {"shift+186", 186, "shift", macro186, menuLane},
+    {"F6", KeyMap::vk("F6"), nullptr, macroF6, chatLane, whileHeld},
+};
+} // namespace Keybinds
+
+#endif
@@ -1,118 +1,33 @@
 #include "keymap.h"
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
 #include <winuser.h>
+#endif
+
+void KeyMap::unknownKeyName() {}
 
-key_to_vk_type g_key_to_vk[] = {{"numpad0", VK_NUMPAD0},
-                                {"numpad1", VK_NUMPAD1},
-                                {"numpad2", VK_NUMPAD2},
-                                {"numpad3", VK_NUMPAD3},
-                                {"numpad4", VK_NUMPAD4},
-                                {"numpad5", VK_NUMPAD5},
-                                {"numpad6", VK_NUMPAD6},
-                                {"numpad7", VK_NUMPAD7},
-                                {"numpad8", VK_NUMPAD8},
-                                {"numpad9", VK_NUMPAD9},
-                                {"numpadmult", VK_MULTIPLY},
-                                {"numpaddiv", VK_DIVIDE},
-                                {"numpadadd", VK_ADD},
-                                {"numpadsub", VK_SUBTRACT},
-                                {"numpaddot", VK_DECIMAL},
-                                {"numlock", VK_NUMLOCK},
-                                {"scrolllock", VK_SCROLL},
-                                {"capslock", VK_CAPITAL},
-                                {"escape", VK_ESCAPE},
-                                {"esc", VK_ESCAPE},
-                                {"tab", VK_TAB},
-                                {"space", VK_SPACE},
-                                {"backspace", VK_BACK},
-                                {"bs", VK_BACK},
-                                {"enter", VK_RETURN},
-                                {"return", VK_RETURN},
-                                {"numpaddel", VK_DELETE},
-                                {"numpadins", VK_INSERT},
-                                {"numpadclear", VK_CLEAR},
-                                {"numpadup", VK_UP},
-                                {"numpaddown", VK_DOWN},
-                                {"numpadleft", VK_LEFT},
-                                {"numpadright", VK_RIGHT},
-                                {"numpadhome", VK_HOME},
-                                {"numpadend", VK_END},
-                                {"numpadpgup", VK_PRIOR},
-                                {"numpadpgdn", VK_NEXT},
-                                {"printscreen", VK_SNAPSHOT},
-                                {"ctrlbreak", VK_CANCEL},
-                                {"pause", VK_PAUSE},
-                                {"break", VK_PAUSE},
-                                {"help", VK_HELP},
-                                {"sleep", VK_SLEEP},
-                                {"appskey", VK_APPS},
-                                {"lcontrol", VK_LCONTROL},
-                                {"rcontrol", VK_RCONTROL},
-                                {"lctrl", VK_LCONTROL},
-                                {"rctrl", VK_RCONTROL},
-                                {"lshift", VK_LSHIFT},
-                                {"rshift", VK_RSHIFT},
-                                {"lalt", VK_LMENU},
-                                {"ralt", VK_RMENU},
-                                {"lwin", VK_LWIN},
-                                {"rwin", VK_RWIN},
-                                {"control", VK_CONTROL},
-                                {"ctrl", VK_CONTROL},
-                                {"alt", VK_MENU},
-                                {"shift", VK_SHIFT},
-                                {"f1", VK_F1},
-                                {"f2", VK_F2},
-                                {"f3", VK_F3},
-                                {"f4", VK_F4},
-                                {"f5", VK_F5},
-                                {"f6", VK_F6},
-                                {"f7", VK_F7},
-                                {"f8", VK_F8},
-                                {"f9", VK_F9},
-                                {"f10", VK_F10},
-                                {"f11", VK_F11},
-                                {"f12", VK_F12},
-                                {"f13", VK_F13},
-                                {"f14", VK_F14},
-                                {"f15", VK_F15},
-                                {"f16", VK_F16},
-                                {"f17", VK_F17},
-                                {"f18", VK_F18},
-                                {"f19", VK_F19},
-                                {"f20", VK_F20},
-                                {"f21", VK_F21},
-                                {"f22", VK_F22},
-                                {"f23", VK_F23},
-                                {"f24", VK_F24},
-                                {"lbutton", VK_LBUTTON},
-                                {"rbutton", VK_RBUTTON},
-                                {"mbutton", VK_MBUTTON},
-                                {"xbutton1", VK_XBUTTON1},
-                                {"xbutton2", VK_XBUTTON2},
-                                {"wheeldown", 0x1000},
-                                {"wheelup", 0x1001},
-                                {"wheelleft", 0x1002},
-                                {"wheelright", 0x1003},
-                                {"browser_back", VK_BROWSER_BACK},
-                                {"browser_forward", VK_BROWSER_FORWARD},
-                                {"browser_refresh", VK_BROWSER_REFRESH},
-                                {"browser_stop", VK_BROWSER_STOP},
-                                {"browser_search", VK_BROWSER_SEARCH},
-                                {"browser_favorites", VK_BROWSER_FAVORITES},
-                                {"browser_home", VK_BROWSER_HOME},
-                                {"volume_mute", VK_VOLUME_MUTE},
-                                {"volume_down", VK_VOLUME_DOWN},
-                                {"volume_up", VK_VOLUME_UP},
-                                {"media_next", VK_MEDIA_NEXT_TRACK},
-                                {"media_prev", VK_MEDIA_PREV_TRACK},
-                                {"media_stop", VK_MEDIA_STOP},
-                                {"media_play_pause", VK_MEDIA_PLAY_PAUSE},
-                                {"launch_mail", VK_LAUNCH_MAIL},
-                                {"launch_media", VK_LAUNCH_MEDIA_SELECT},
-                                {"launch_app1", VK_LAUNCH_APP1},
-                                {"launch_app2", VK_LAUNCH_APP2},
-                                {"up", VK_UP},
-                                {"left", VK_LEFT},
-                                {"down", VK_DOWN},
-                                {"right", VK_RIGHT}};
+namespace InputHandler {
+std::optional<uint16_t> findKey(std::string_view keyToFind) {
+  std::optional<uint16_t> vkCode = KeyMap::lookupKey(keyToFind);
+  if (vkCode.has_value() || keyToFind.size() != 1) {
+    if (!vkCode.has_value()) {
+      printf("Failed to find keycode for: %.*s\n", (int)keyToFind.size(),
+             keyToFind.data());
+    }
+    return vkCode;
+  }
 
-const size_t g_key_to_vk_size = sizeof(g_key_to_vk) / sizeof(g_key_to_vk[0]);
\ No newline at end of file
+#ifdef _WIN32
+  // Punctuation depends on the keyboard layout
+  SHORT vk = VkKeyScan(KeyMap::toLower(keyToFind[0]));
+  if (vk != -1) {
+    return LOBYTE(vk);
+  }
+#endif
+  printf("Failed to find keycode for: %.*s\n", (int)keyToFind.size(),
+         keyToFind.data());
+  return std::nullopt;
+}
+} // namespace InputHandler
@@ -1,16 +1,232 @@
 #ifndef KEYMAP_H
 #define KEYMAP_H
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
 #include <windows.h>
+#else
+#include "vkcodes.h"
+#endif
 
 struct key_to_vk_type {
-  std::string keyName;
-  int vkCode;
+  std::string_view keyName; // lowercase
+  uint16_t vkCode;
 };
 
-extern key_to_vk_type g_key_to_vk[];
+namespace KeyMap {
+constexpr char toLower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+// Case-insensitive, key is lowered one char at a time instead of copied
+constexpr int compareName(std::string_view name, std::string_view key) {
+  size_t length = std::min(name.size(), key.size());
+  for (size_t i = 0; i < length; i++) {
+    char a = name[i];
+    char b = toLower(key[i]);
+    if (a != b) {
+      return a < b ? -1 : 1;
+    }
+  }
+  return name.size() == key.size() ? 0 : (name.size() < key.size() ? -1 : 1);
+}
+
+template <size_t N>
+constexpr std::array<key_to_vk_type, N> sortKeys(std::array<key_to_vk_type, N> keys) {
+  std::sort(keys.begin(), keys.end(), [](const key_to_vk_type &a, const key_to_vk_type &b) {
+    return a.keyName < b.keyName;
+  });
+  return keys;
+}
+} // namespace KeyMap
+
+// Sorted by name at compile time so lookups are a binary search
+constexpr auto g_key_to_vk = KeyMap::sortKeys(std::array<key_to_vk_type, 113>{{
+    {"numpad0", VK_NUMPAD0},
+    {"numpad1", VK_NUMPAD1},
+    {"numpad2", VK_NUMPAD2},
+    {"numpad3", VK_NUMPAD3},
+    {"numpad4", VK_NUMPAD4},
+    {"numpad5", VK_NUMPAD5},
+    {"numpad6", VK_NUMPAD6},
+    {"numpad7", VK_NUMPAD7},
+    {"numpad8", VK_NUMPAD8},
+    {"numpad9", VK_NUMPAD9},
+    {"numpadmult", VK_MULTIPLY},
+    {"numpaddiv", VK_DIVIDE},
+    {"numpadadd", VK_ADD},
+    {"numpadsub", VK_SUBTRACT},
+    {"numpaddot", VK_DECIMAL},
+    {"numlock", VK_NUMLOCK},
+    {"scrolllock", VK_SCROLL},
+    {"capslock", VK_CAPITAL},
+    {"escape", VK_ESCAPE},
+    {"esc", VK_ESCAPE},
+    {"tab", VK_TAB},
+    {"space", VK_SPACE},
+    {"backspace", VK_BACK},
+    {"bs", VK_BACK},
+    {"enter", VK_RETURN},
+    {"return", VK_RETURN},
+    {"numpaddel", VK_DELETE},
+    {"numpadins", VK_INSERT},
+    {"numpadclear", VK_CLEAR},
+    {"numpadup", VK_UP},
+    {"numpaddown", VK_DOWN},
+    {"numpadleft", VK_LEFT},
+    {"numpadright", VK_RIGHT},
+    {"numpadhome", VK_HOME},
+    {"numpadend", VK_END},
+    {"numpadpgup", VK_PRIOR},
+    {"numpadpgdn", VK_NEXT},
+    {"printscreen", VK_SNAPSHOT},
+    {"ctrlbreak", VK_CANCEL},
+    {"pause", VK_PAUSE},
+    {"break", VK_PAUSE},
+    {"help", VK_HELP},
+    {"sleep", VK_SLEEP},
+    {"appskey", VK_APPS},
+    {"lcontrol", VK_LCONTROL},
+    {"rcontrol", VK_RCONTROL},
+    {"lctrl", VK_LCONTROL},
+    {"rctrl", VK_RCONTROL},
+    {"lshift", VK_LSHIFT},
+    {"rshift", VK_RSHIFT},
+    {"lalt", VK_LMENU},
+    {"ralt", VK_RMENU},
+    {"lwin", VK_LWIN},
+    {"rwin", VK_RWIN},
+    {"control", VK_CONTROL},
+    {"ctrl", VK_CONTROL},
+    {"alt", VK_MENU},
+    {"shift", VK_SHIFT},
+    {"f1", VK_F1},
+    {"f2", VK_F2},
+    {"f3", VK_F3},
+    {"f4", VK_F4},
+    {"f5", VK_F5},
+    {"f6", VK_F6},
+    {"f7", VK_F7},
+    {"f8", VK_F8},
+    {"f9", VK_F9},
+    {"f10", VK_F10},
+    {"f11", VK_F11},
+    {"f12", VK_F12},
+    {"f13", VK_F13},
+    {"f14", VK_F14},
+    {"f15", VK_F15},
+    {"f16", VK_F16},
+    {"f17", VK_F17},
+    {"f18", VK_F18},
+    {"f19", VK_F19},
+    {"f20", VK_F20},
+    {"f21", VK_F21},
+    {"f22", VK_F22},
+    {"f23", VK_F23},
+    {"f24", VK_F24},
+    {"lbutton", VK_LBUTTON},
+    {"rbutton", VK_RBUTTON},
+    {"mbutton", VK_MBUTTON},
+    {"xbutton1", VK_XBUTTON1},
+    {"xbutton2", VK_XBUTTON2},
+    {"wheeldown", 0x1000},
+    {"wheelup", 0x1001},
+    {"wheelleft", 0x1002},
+    {"wheelright", 0x1003},
+    {"browser_back", VK_BROWSER_BACK},
+    {"browser_forward", VK_BROWSER_FORWARD},
+    {"browser_refresh", VK_BROWSER_REFRESH},
+    {"browser_stop", VK_BROWSER_STOP},
+    {"browser_search", VK_BROWSER_SEARCH},
+    {"browser_favorites", VK_BROWSER_FAVORITES},
+    {"browser_home", VK_BROWSER_HOME},
+    {"volume_mute", VK_VOLUME_MUTE},
+    {"volume_down", VK_VOLUME_DOWN},
+    {"volume_up", VK_VOLUME_UP},
+    {"media_next", VK_MEDIA_NEXT_TRACK},
+    {"media_prev", VK_MEDIA_PREV_TRACK},
+    {"media_stop", VK_MEDIA_STOP},
+    {"media_play_pause", VK_MEDIA_PLAY_PAUSE},
+    {"launch_mail", VK_LAUNCH_MAIL},
+    {"launch_media", VK_LAUNCH_MEDIA_SELECT},
+    {"launch_app1", VK_LAUNCH_APP1},
+    {"launch_app2", VK_LAUNCH_APP2},
+    {"up", VK_UP},
+    {"left", VK_LEFT},
+    {"down", VK_DOWN},
+    {"right", VK_RIGHT}
+}});
+
+constexpr size_t g_key_to_vk_size = g_key_to_vk.size();
+
+namespace KeyMap {
+constexpr bool isValidTable() {
+  for (size_t i = 0; i < g_key_to_vk_size; i++) {
+    for (char c : g_key_to_vk[i].keyName) {
+      if (c != toLower(c)) {
+        return false;
+      }
+    }
+    if (i > 0 && g_key_to_vk[i - 1].keyName == g_key_to_vk[i].keyName) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(isValidTable(), "Key names must be lowercase and unique");
+
+// Table names, then single letters and digits, whose virtual-key code is
+// just the uppercase character. Anything else isn't known at compile time.
+constexpr std::optional<uint16_t> lookupKey(std::string_view key) {
+  size_t low = 0;
+  size_t high = g_key_to_vk_size;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int order = compareName(g_key_to_vk[mid].keyName, key);
+    if (order == 0) {
+      return g_key_to_vk[mid].vkCode;
+    }
+    if (order < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (key.size() == 1) {
+    char c = key[0];
+    if (c >= 'a' && c <= 'z') {
+      return c - 'a' + 'A';
+    }
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+      return c;
+    }
+  }
+  return std::nullopt;
+}
+
+void unknownKeyName(); // not constexpr, calling it at compile time is the error
+
+// vk("F2") is checked and resolved by the compiler
+consteval uint16_t vk(std::string_view key) {
+  std::optional<uint16_t> vkCode = lookupKey(key);
+  if (!vkCode.has_value()) {
+    unknownKeyName();
+  }
+  return vkCode.value();
+}
+} // namespace KeyMap
 
-extern const size_t g_key_to_vk_size;
+namespace InputHandler {
+// lookupKey plus the keyboard layout for single characters like ';', for
+// names that only show up at runtime
+std::optional<uint16_t> findKey(std::string_view keyToFind);
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,74 @@
+#include "keysource.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#endif
+
+namespace KeySource {
+
+#ifdef _WIN32
+// The hook procedure can't carry any state, there is only one hook anyway
+static HHOOK keyboardHook;
+static Handler *hookHandler;
+static constexpr UINT postedMessage = WM_APP + 1;
+
+static LRESULT CALLBACK onKeyPress(int nCode, WPARAM wParam, LPARAM lParam) {
+  if (nCode == HC_ACTION) {
+    // lParam is a pointer to a KBDLLHOOKSTRUCT
+    KBDLLHOOKSTRUCT *pKeyBoard = (KBDLLHOOKSTRUCT *)lParam;
+    Event event = {(uint8_t)pKeyBoard->vkCode,
+                   wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN,
+                   (pKeyBoard->flags & LLKHF_INJECTED) != 0};
+    if (hookHandler->onKey(event)) {
+      return 1;
+    }
+  }
+  return CallNextHookEx(keyboardHook, nCode, wParam, lParam);
+}
+
+bool HookSource::start(Handler &handler) {
+  threadId = GetCurrentThreadId();
+  hookHandler = &handler;
+  keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, onKeyPress, GetModuleHandle(NULL), 0);
+  return keyboardHook != NULL;
+}
+
+void HookSource::run() {
+  MSG msg;
+  while (GetMessage(&msg, NULL, 0, 0)) {
+    if (msg.message == postedMessage) {
+      ((void (*)(void *))msg.wParam)((void *)msg.lParam);
+      continue;
+    }
+    TranslateMessage(&msg);
+    DispatchMessage(&msg);
+  }
+  UnhookWindowsHookEx(keyboardHook);
+}
+
+void HookSource::stop() { PostThreadMessage(threadId, WM_QUIT, 0, 0); }
+
+void HookSource::post(void (*function)(void *), void *argument) {
+  PostThreadMessage(threadId, postedMessage, (WPARAM)function, (LPARAM)argument);
+}
+#endif
+
+void ScriptedSource::runPosted() {
+  for (const Posted &call : posted) {
+    call.function(call.argument);
+  }
+  posted.clear();
+}
+
+void ScriptedSource::run() {
+  stopped = false;
+  for (size_t i = 0; i < events.size() && !stopped; i++) {
+    runPosted();
+    eaten += handler->onKey(events[i]);
+  }
+  runPosted();
+}
+} // namespace KeySource
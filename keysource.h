@@ -0,0 +1,88 @@
+#ifndef KEYSOURCE_H
+#define KEYSOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where key events come from. On Windows that's the low-level keyboard hook,
+// which delivers everything on the thread that installed it through its
+// message loop. Off Windows events are scripted so the whole path from a key
+// event to a queued macro runs without a desktop.
+namespace KeySource {
+struct Event {
+  uint8_t vkCode;
+  bool down;
+  bool injected; // sent by a program (us included), not a physical key
+};
+
+class Handler {
+public:
+  virtual ~Handler() = default;
+  // True if the event belongs to a keybind and shouldn't reach the game
+  virtual bool onKey(const Event &event) = 0;
+};
+
+class Source {
+public:
+  virtual ~Source() = default;
+  // Starts delivering to handler. False if it can't, the hook failing to
+  // install on Windows.
+  virtual bool start(Handler &handler) = 0;
+  // Delivers events on the calling thread until stop
+  virtual void run() = 0;
+  // From any thread
+  virtual void stop() = 0;
+  // Runs function(argument) on the run thread between events. Anything the
+  // handler could still be looking at can be freed from there.
+  virtual void post(void (*function)(void *), void *argument) = 0;
+};
+
+#ifdef _WIN32
+// WH_KEYBOARD_LL. The message loop in run also delivers anything else sent to
+// the thread, like out of context WinEvent hooks.
+class HookSource : public Source {
+public:
+  bool start(Handler &handler) override;
+  void run() override;
+  void stop() override;
+  void post(void (*function)(void *), void *argument) override;
+
+private:
+  unsigned long threadId = 0;
+};
+#endif
+
+// Hands out events given up front, in order, then returns from run. Posted
+// functions run before the next event, like they would between two hook
+// calls. Single threaded, post and stop only from inside the handler.
+class ScriptedSource : public Source {
+public:
+  bool start(Handler &handler) override {
+    this->handler = &handler;
+    return true;
+  }
+  void run() override;
+  void stop() override { stopped = true; }
+  void post(void (*function)(void *), void *argument) override {
+    posted.push_back({function, argument});
+  }
+
+  std::vector<Event> events;
+  uint64_t eaten = 0; // events the handler said to keep from the game
+
+private:
+  struct Posted {
+    void (*function)(void *);
+    void *argument;
+  };
+
+  void runPosted();
+
+  Handler *handler = nullptr;
+  bool stopped = false;
+  std::vector<Posted> posted;
+};
+} // namespace KeySource
+
+#endif
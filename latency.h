@@ -0,0 +1,70 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace Latency {
+// Power of two microsecond buckets, bucket i holds [2^(i-1), 2^i) µs and
+// bucket 0 everything under 1µs. One thread records, any thread can print.
+class Histogram {
+public:
+  static constexpr int bucketCount = 24; // the last one is everything >= ~4s
+
+  void record(std::chrono::steady_clock::duration elapsed) {
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    int bucket = 0;
+    while (us > 0 && bucket < bucketCount - 1) {
+      us >>= 1;
+      bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (ns > maxNs.load(std::memory_order_relaxed)) {
+      maxNs.store(ns, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t count() const {
+    uint64_t total = 0;
+    for (const auto &bucket : buckets) {
+      total += bucket.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  // Upper bound of the bucket the percentile falls in, in µs
+  uint64_t percentileUs(double percentile) const {
+    uint64_t total = count();
+    uint64_t seen = 0;
+    for (int i = 0; i < bucketCount; i++) {
+      seen += buckets[i].load(std::memory_order_relaxed);
+      if (total != 0 && seen >= total * percentile) {
+        return 1ull << i;
+      }
+    }
+    return 1ull << (bucketCount - 1);
+  }
+
+  void print(FILE *file, const char *name) const {
+    fprintf(file, "%s: %llu samples, p50 <%lluus, p99 <%lluus, max %.1fus\n", name,
+            (unsigned long long)count(), (unsigned long long)percentileUs(0.5),
+            (unsigned long long)percentileUs(0.99),
+            maxNs.load(std::memory_order_relaxed) / 1000.0);
+    for (int i = 0; i < bucketCount; i++) {
+      uint64_t n = buckets[i].load(std::memory_order_relaxed);
+      if (n != 0) {
+        fprintf(file, "  <%8lluus %llu\n", 1ull << i, (unsigned long long)n);
+      }
+    }
+  }
+
+private:
+  std::atomic<uint64_t> buckets[bucketCount] = {};
+  std::atomic<uint64_t> maxNs = 0;
+};
+} // namespace Latency
+
+#endif
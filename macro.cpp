@@ -0,0 +1,158 @@
+#include "macro.h"
+#include <cstdio>
+#include <deque>
+
+namespace Macro {
+// deque so programs never move once handed out
+std::deque<Program> programs;
+
+void invalidMacroInput() {}
+
+static void emit(Program &program, Opcode op, uint16_t vkCode, bool recursive) {
+  program.instructions.push_back({op, recursive, vkCode});
+}
+
+static void compileInput(std::string_view input, size_t index, Program &program,
+                         std::vector<ParseError> &errors) {
+  ParsedInput parsed;
+  if (const char *error = parseInput(input, parsed)) {
+    errors.push_back({index, std::string(input), error});
+    return;
+  }
+
+  if (parsed.name == "sleep") {
+    for (int j = 0; j < parsed.amount; j++) {
+      emit(program, Opcode::Sleep, 0, parsed.recursive);
+    }
+    return;
+  }
+
+  std::optional<uint16_t> keyOpt = InputHandler::findKey(parsed.name);
+  if (!keyOpt.has_value()) {
+    errors.push_back({index, std::string(input),
+                      "unknown key \"" + std::string(parsed.name) + "\""});
+    return;
+  }
+  uint16_t vkCode = keyOpt.value();
+
+  if (parsed.name == "wheelup" || parsed.name == "wheeldown") {
+    emit(program, Opcode::Wheel, vkCode, false);
+    emit(program, Opcode::Sleep, 0, false);
+    return;
+  }
+
+  // Schizo up and down logic because it is faster
+  /*
+  if ((parsed.name == "up" || parsed.name == "down") && parsed.amount != 1 &&
+      !parsed.hasState) {
+    uint16_t wheelInput = InputHandler::findKey("wheel" + std::string(parsed.name)).value();
+    for (int j = 0; j < floor(parsed.amount / 2); j++) {
+      emit(program, Opcode::KeyDown, vkCode, false);
+      emit(program, Opcode::KeyUp, vkCode, true);
+      emit(program, Opcode::KeyUp, wheelInput, false);
+      if (parsed.amount >= 3) {
+        emit(program, Opcode::Sleep, 0, false);
+      }
+    }
+    if (parsed.amount & 1) {
+      emit(program, Opcode::KeyDown, vkCode, false);
+      emit(program, Opcode::KeyUp, vkCode, true);
+    }
+    return;
+  }
+    */
+
+  for (int j = 0; j < parsed.amount; j++) {
+    if (parsed.hasState) {
+      emit(program, parsed.state ? Opcode::KeyDown : Opcode::KeyUp, vkCode,
+           parsed.recursive);
+    } else {
+      emit(program, Opcode::KeyDown, vkCode, false);
+      emit(program, Opcode::KeyUp, vkCode, parsed.recursive);
+    }
+  }
+}
+
+static bool finish(Program &program, size_t errorsBefore,
+                   std::vector<ParseError> &errors,
+                   std::function<void()> callback) {
+  if (errors.size() != errorsBefore) {
+    program.instructions.clear();
+    return false;
+  }
+  if (callback) {
+    emit(program, Opcode::Callback, 0, true);
+    program.callback = std::move(callback);
+  }
+  program.instructions.shrink_to_fit();
+  return true;
+}
+
+bool compile(const std::vector<std::string> &inputs, Program &program,
+             std::vector<ParseError> &errors, std::function<void()> callback) {
+  size_t errorsBefore = errors.size();
+  program.instructions.clear();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    compileInput(inputs[i], i, program, errors);
+  }
+  return finish(program, errorsBefore, errors, std::move(callback));
+}
+
+bool compile(std::span<const Input> inputs, Program &program,
+             std::vector<ParseError> &errors, std::function<void()> callback) {
+  size_t errorsBefore = errors.size();
+  program.instructions.clear();
+  size_t i = 0;
+  for (const Input &input : inputs) {
+    compileInput(input.text, i++, program, errors);
+  }
+  return finish(program, errorsBefore, errors, std::move(callback));
+}
+
+static const Program *keepOrReport(const std::string &name, Program &program,
+                                   bool compiled,
+                                   const std::vector<ParseError> &errors) {
+  if (!compiled) {
+    for (const ParseError &error : errors) {
+      fprintf(stderr, "Macro %s, input %zu \"%s\": %s\n", name.c_str(),
+              error.index, error.input.c_str(), error.message.c_str());
+    }
+    return nullptr;
+  }
+  program.name = name;
+  return keep(std::move(program));
+}
+
+const Program *keep(Program program) {
+  // Reloading a macro file keeps handing back the same macros, those don't
+  // pile up. Programs with a callback can't be compared.
+  if (!program.callback) {
+    for (const Program &kept : programs) {
+      if (!kept.callback && kept.name == program.name &&
+          kept.instructions == program.instructions) {
+        return &kept;
+      }
+    }
+  }
+  programs.push_back(std::move(program));
+  return &programs.back();
+}
+
+const Program *compileOrReport(const std::string &name,
+                               const std::vector<std::string> &inputs,
+                               std::function<void()> callback) {
+  Program program;
+  std::vector<ParseError> errors;
+  bool compiled = compile(inputs, program, errors, std::move(callback));
+  return keepOrReport(name, program, compiled, errors);
+}
+
+const Program *compileOrReport(const std::string &name,
+                               std::span<const Input> inputs,
+                               std::function<void()> callback) {
+  Program program;
+  std::vector<ParseError> errors;
+  bool compiled = compile(inputs, program, errors, std::move(callback));
+  return keepOrReport(name, program, compiled, errors);
+}
+} // namespace Macro
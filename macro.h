@@ -0,0 +1,148 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include "keymap.h"
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Macro {
+enum class Opcode : uint8_t {
+  KeyDown,
+  KeyUp,
+  Wheel,
+  Sleep,
+  Callback, // calls Program::callback
+};
+
+// One frame-synchronized step, the same thing queueInput used to push as a
+// Task. Repeat counts are unrolled and "sleep N" turned into N Sleeps when
+// compiling so running a program is just walking the array.
+struct Instruction {
+  Opcode op;
+  bool recursive; // the R suffix, run the next instruction in the same frame
+  uint16_t vkCode;
+
+  bool operator==(const Instruction &) const = default;
+};
+
+struct Program {
+  std::string name; // for telemetry, empty for queueInputs
+  std::vector<Instruction> instructions;
+  std::function<void()> callback;
+};
+
+// One queueInputs string split into its parts. Same grammar the old
+// (\w+?)(?:\s(down|up|\d+))?(R)? regex accepted.
+struct ParsedInput {
+  std::string_view name;
+  bool hasState = false; // "down" or "up" given
+  bool state = false;
+  int amount = 1;
+  bool recursive = false;
+};
+
+constexpr bool isWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// nullptr on success, otherwise what's wrong with the input
+constexpr const char *parseInput(std::string_view input, ParsedInput &parsed) {
+  parsed = {};
+  // The name needs at least one char, so a lone "R" is a key
+  if (input.size() > 1 && input.back() == 'R') {
+    parsed.recursive = true;
+    input.remove_suffix(1);
+  }
+
+  size_t space = input.find_first_of(" \t");
+  parsed.name = input.substr(0, space);
+  if (parsed.name.empty()) {
+    return "missing key name";
+  }
+  for (char c : parsed.name) {
+    if (!isWordChar(c)) {
+      return "key names are letters, digits and _";
+    }
+  }
+  if (space == std::string_view::npos) {
+    return nullptr;
+  }
+
+  std::string_view argument = input.substr(space + 1);
+  if (argument == "down" || argument == "up") {
+    parsed.hasState = true;
+    parsed.state = argument == "down";
+    return nullptr;
+  }
+  if (argument.empty()) {
+    return "expected down, up or a count after the space";
+  }
+  parsed.amount = 0;
+  for (char c : argument) {
+    if (c < '0' || c > '9') {
+      return "expected down, up or a count after the space";
+    }
+    if (parsed.amount > 100000) {
+      return "count is too big";
+    }
+    parsed.amount = parsed.amount * 10 + (c - '0');
+  }
+  return nullptr;
+}
+
+void invalidMacroInput(); // not constexpr, calling it at compile time is the error
+
+// A macro input written as a literal, checked by the compiler: a typo like
+// "entr down" or "up seven" in addKeybinds doesn't build.
+struct Input {
+  consteval Input(const char *input) : text(input) {
+    ParsedInput parsed;
+    if (parseInput(text, parsed) != nullptr) {
+      invalidMacroInput();
+    }
+    if (parsed.name != "sleep" && !KeyMap::lookupKey(parsed.name).has_value()) {
+      KeyMap::unknownKeyName();
+    }
+  }
+
+  std::string_view text;
+};
+
+struct ParseError {
+  size_t index; // which input string
+  std::string input;
+  std::string message;
+};
+
+// Parses the queueInputs syntax ("enter", "enter down", "up 7", "mR",
+// "sleep 2", ...). Every bad input is reported, not just the first one, and
+// program is left empty if there were any.
+bool compile(const std::vector<std::string> &inputs, Program &program,
+             std::vector<ParseError> &errors,
+             std::function<void()> callback = nullptr);
+bool compile(std::span<const Input> inputs, Program &program,
+             std::vector<ParseError> &errors,
+             std::function<void()> callback = nullptr);
+
+// Compiles and keeps the program alive for the rest of the process, so
+// tasks can point at it. Errors go to stderr and give nullptr.
+const Program *compileOrReport(const std::string &name,
+                               const std::vector<std::string> &inputs,
+                               std::function<void()> callback = nullptr);
+const Program *compileOrReport(const std::string &name,
+                               std::span<const Input> inputs,
+                               std::function<void()> callback = nullptr);
+
+// Keeps an already compiled program alive for the rest of the process. One
+// kept before with the same name and instructions is handed out again
+// instead. Not thread safe, only one thread at a time may compile programs
+// to keep.
+const Program *keep(Program program);
+} // namespace Macro
+
+#endif
@@ -0,0 +1,245 @@
+#include "macrofile.h"
+#include "keymap.h"
+#include "scheduler.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace std::chrono_literals;
+
+namespace MacroFile {
+
+static std::string_view trim(std::string_view text) {
+  size_t start = text.find_first_not_of(" \t\r");
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(start, end - start + 1);
+}
+
+static bool parseNumber(std::string_view text, uint32_t &number) {
+  if (text.empty() || text.size() > 9) {
+    return false;
+  }
+  number = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    number = number * 10 + (c - '0');
+  }
+  return true;
+}
+
+// A key name or a raw vk code like 220
+static bool parseKey(std::string_view text, uint16_t &vkCode) {
+  uint32_t number;
+  if (parseNumber(text, number)) {
+    if (number == 0 || number > 0xFF) {
+      return false;
+    }
+    vkCode = number;
+    return true;
+  }
+  std::optional<uint16_t> found = InputHandler::findKey(text);
+  if (!found.has_value() || found.value() > 0xFF) {
+    return false;
+  }
+  vkCode = found.value();
+  return true;
+}
+
+// Everything left of the =
+static const char *parseBinding(std::string_view text, Entry &entry) {
+  size_t space = text.find_first_of(" \t");
+  std::string_view keys = text.substr(0, space);
+  entry.key = std::string(keys);
+  while (true) {
+    size_t plus = keys.find('+');
+    uint16_t vkCode;
+    if (!parseKey(keys.substr(0, plus), vkCode)) {
+      return "unknown key";
+    }
+    if (plus == std::string_view::npos) {
+      entry.vkCode = vkCode;
+      break;
+    }
+    entry.modifiers.push_back(vkCode);
+    keys.remove_prefix(plus + 1);
+  }
+
+  std::string_view options = space == std::string_view::npos ? "" : text.substr(space);
+  while (!(options = trim(options)).empty()) {
+    size_t end = options.find_first_of(" \t");
+    std::string_view option = options.substr(0, end);
+    options = end == std::string_view::npos ? "" : options.substr(end);
+    if (option == "held") {
+      entry.times = 0;
+      continue;
+    }
+    if (option != "lane" && option != "times") {
+      return "expected lane, times or held after the key";
+    }
+    options = trim(options);
+    end = options.find_first_of(" \t");
+    uint32_t number;
+    if (!parseNumber(options.substr(0, end), number)) {
+      return "expected a number";
+    }
+    options = end == std::string_view::npos ? "" : options.substr(end);
+    if (option == "lane") {
+      if (number >= (uint32_t)InputHandler::maxLanes) {
+        return "no such lane";
+      }
+      entry.lane = number;
+    } else {
+      if (number == 0) {
+        return "times has to be at least 1, use held to repeat while held";
+      }
+      entry.times = number;
+    }
+  }
+  return nullptr;
+}
+
+bool parse(std::string_view text, const std::vector<Entry> *previous,
+           std::vector<Entry> &entries, std::vector<Error> &errors) {
+  size_t errorsBefore = errors.size();
+  entries.clear();
+  std::vector<size_t> lines; // of each entry, for duplicates
+  std::vector<std::string> inputs;
+  // Compiled programs only get kept once the whole file is fine, a file with
+  // an error in it shouldn't keep anything. Their entries have no
+  // program until then.
+  std::vector<Macro::Program> staged;
+  std::vector<size_t> stagedFor; // entry index of each staged program
+  size_t lineNumber = 0;
+  while (!text.empty()) {
+    lineNumber++;
+    size_t newline = text.find('\n');
+    std::string_view line = trim(text.substr(0, newline));
+    text = newline == std::string_view::npos ? "" : text.substr(newline + 1);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    size_t equals = line.find('=');
+    if (equals == std::string_view::npos) {
+      errors.push_back({lineNumber, "expected key = inputs"});
+      continue;
+    }
+    Entry entry;
+    if (const char *error = parseBinding(trim(line.substr(0, equals)), entry)) {
+      errors.push_back({lineNumber, error});
+      continue;
+    }
+
+    bool duplicate = false;
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (entries[i].vkCode == entry.vkCode && entries[i].modifiers == entry.modifiers) {
+        errors.push_back({lineNumber, entry.key + " is already bound on line " +
+                                          std::to_string(lines[i])});
+        duplicate = true;
+        break;
+      }
+    }
+    if (duplicate) {
+      continue;
+    }
+
+    inputs.clear();
+    std::string_view rest = line.substr(equals + 1);
+    while (true) {
+      size_t comma = rest.find(',');
+      inputs.emplace_back(trim(rest.substr(0, comma)));
+      if (comma == std::string_view::npos) {
+        break;
+      }
+      rest.remove_prefix(comma + 1);
+    }
+
+    Macro::Program program;
+    std::vector<Macro::ParseError> inputErrors;
+    if (!Macro::compile(inputs, program, inputErrors)) {
+      for (const Macro::ParseError &error : inputErrors) {
+        errors.push_back({lineNumber, "\"" + error.input + "\": " + error.message});
+      }
+      continue;
+    }
+
+    entry.program = nullptr;
+    if (previous != nullptr) {
+      for (const Entry &old : *previous) {
+        if (old.vkCode == entry.vkCode && old.modifiers == entry.modifiers &&
+            old.program->instructions == program.instructions) {
+          entry.program = old.program;
+          break;
+        }
+      }
+    }
+    if (entry.program == nullptr) {
+      program.name = entry.key;
+      staged.push_back(std::move(program));
+      stagedFor.push_back(entries.size());
+    }
+    entries.push_back(std::move(entry));
+    lines.push_back(lineNumber);
+  }
+
+  if (errors.size() != errorsBefore) {
+    entries.clear();
+    return false;
+  }
+  for (size_t i = 0; i < staged.size(); i++) {
+    entries[stagedFor[i]].program = Macro::keep(std::move(staged[i]));
+  }
+  return true;
+}
+
+bool load(const char *path, const std::vector<Entry> *previous,
+          std::vector<Entry> &entries, std::vector<Error> &errors) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    errors.push_back({0, std::string("couldnt open ") + path});
+    return false;
+  }
+  std::string text;
+  char buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+    text.append(buffer, read);
+  }
+  fclose(file);
+  return parse(text, previous, entries, errors);
+}
+
+void Watcher::start(std::string path, std::function<void()> onChange) {
+  stop();
+  running = true;
+  thread = std::thread([this, path = std::move(path), onChange = std::move(onChange)]() {
+    std::error_code error;
+    std::filesystem::file_time_type last = std::filesystem::last_write_time(path, error);
+    bool existed = !error;
+    while (running) {
+      std::this_thread::sleep_for(250ms);
+      std::filesystem::file_time_type now = std::filesystem::last_write_time(path, error);
+      if (error) {
+        existed = false; // gone, or mid save by an editor that replaces it
+        continue;
+      }
+      if (!existed || now != last) {
+        existed = true;
+        last = now;
+        onChange();
+      }
+    }
+  });
+}
+
+void Watcher::stop() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+} // namespace MacroFile
@@ -0,0 +1,64 @@
+#ifndef MACROFILE_H
+#define MACROFILE_H
+
+#include "macro.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Keybinds from a text file instead of keybinds.h, one per line:
+//
+//   # comment
+//   shift+221 = mR, enter down, up 6, enter up
+//   F6 lane 1 held = enter downR, t, hR, eR, lR, lR, o, enter up
+//   F7 times 3 = e
+//
+// The key is a name findKey knows or a raw vk code, with modifiers in front
+// joined by +. After it optionally the lane (default 0) and either
+// "times <n>" or "held" for repeating while the key is down. The inputs are
+// the usual macro inputs separated by commas.
+namespace MacroFile {
+struct Entry {
+  std::string key; // as written, for messages
+  uint16_t vkCode;
+  std::vector<uint16_t> modifiers;
+  int lane = 0;
+  uint32_t times = 1; // 0 while held, same as Keybinds::whileHeld
+  const Macro::Program *program;
+};
+
+struct Error {
+  size_t line;
+  std::string message;
+};
+
+// Parses and compiles everything. Any error anywhere and entries is left
+// empty, a half loaded file is worse than the old one, and nothing is kept.
+// Programs that come out the same as the one for the same key in previous
+// are reused, and Macro::keep hands back ones it kept before, so reloading
+// and editing back and forth doesn't keep adding programs.
+bool parse(std::string_view text, const std::vector<Entry> *previous,
+           std::vector<Entry> &entries, std::vector<Error> &errors);
+bool load(const char *path, const std::vector<Entry> *previous,
+          std::vector<Entry> &entries, std::vector<Error> &errors);
+
+// Calls onChange from its own thread whenever the file's modification time
+// changes, including when it shows up after not existing.
+class Watcher {
+public:
+  ~Watcher() { stop(); }
+  void start(std::string path, std::function<void()> onChange);
+  void stop();
+
+private:
+  std::thread thread;
+  std::atomic<bool> running = false;
+};
+} // namespace MacroFile
+
+#endif
@@ -1,21 +1,32 @@
+#include "foreground.h"
+#include "framesource.h"
+#include "hookdispatch.h"
+#include "keybinds.h"
 #include "keymap.h"
-#include <Psapi.h>
+#include "keysource.h"
+#include "macro.h"
+#include "macrofile.h"
+#include "outputsink.h"
+#include "process.h"
+#include "rtssreader.h"
+#include "scheduler.h"
+#include "telemetry.h"
 #include <Windows.h>
 #include <algorithm>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <mmsystem.h>
-#include <mutex>
 #include <optional>
 #include <profileapi.h>
 #include <queue>
-#include <regex>
 #include <stdio.h>
 #include <string>
 #include <tchar.h>
 #include <thread>
-#include <tlhelp32.h>
+#include <utility>
 #include <vector>
 #include <winnt.h>
 #include <winuser.h>
@@ -23,636 +34,415 @@
 #pragma comment(lib, "winmm.lib")
 using namespace std::chrono_literals;
 
-std::string getActiveProcessName() {
-  HWND foregroundWindow = GetForegroundWindow();
-  if (foregroundWindow == NULL) {
-    return "No active window";
-  }
-
-  DWORD processId;
-  GetWindowThreadProcessId(foregroundWindow, &processId);
-
-  HANDLE processHandle = OpenProcess(
-      PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, processId);
-  if (processHandle == NULL) {
-    return "Failed to open process";
-  }
-
-  TCHAR processName[MAX_PATH];
-  if (GetModuleFileNameEx(processHandle, NULL, processName, MAX_PATH) == 0) {
-    CloseHandle(processHandle);
-    return "Failed to get process name";
-  }
-
-  CloseHandle(processHandle);
+// Only looks the foreground process up again when the focused window changes
+static Foreground::WindowsProvider foregroundProvider;
+static Foreground::Tracker foregroundTracker(foregroundProvider);
 
-  // To get just the executable name from the full path
-  std::wstring fullPath(processName, processName + lstrlen(processName));
-  size_t lastBackslash = fullPath.find_last_of(L"\\");
-  if (lastBackslash != std::wstring::npos) {
-    return std::string(fullPath.begin() + lastBackslash + 1, fullPath.end());
-  }
-
-  return std::string(fullPath.begin(), fullPath.end());
+void CALLBACK onForegroundChanged(HWINEVENTHOOK, DWORD, HWND window, LONG,
+                                  LONG, DWORD, DWORD) {
+  foregroundTracker.onForegroundChanged(
+      reinterpret_cast<Foreground::Window>(window));
 }
 
-bool isProcessRunning(const TCHAR *processName) {
-  PROCESSENTRY32 entry;
-  entry.dwSize = sizeof(PROCESSENTRY32);
-
-  HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, NULL);
-
-  if (Process32First(snapshot, &entry)) {
-    while (Process32Next(snapshot, &entry)) {
-      if (_tcscmp(entry.szExeFile, processName) == 0) {
-        CloseHandle(snapshot);
-        return true;
-      }
-    }
-  }
-
-  CloseHandle(snapshot);
-  return false;
-}
-
-namespace RTSSReader {
-DWORD frametimeMemoryOffset = 280;
-// DWORD framesGeneratedMemoryOffset = 332;
-HANDLE hMapFile;
-LPVOID pMapAddr;
-uintptr_t processEntryAddress;
-std::string targetProcess;
-
-void initialize() {
-  if (isProcessRunning("GTA5_Enhanced.exe")) {
-    targetProcess = "GTA5_Enhanced.exe";
-  } else if (isProcessRunning("GTA5.exe")) {
-    targetProcess = "GTA5.exe";
-  } else if (isProcessRunning("game_win64_final.exe")) {
-    targetProcess = "game_win64_final.exe";
-  } else {
-    fprintf(stderr, "Could not find GTA process. Is it running?");
-    exit(1);
-  }
-  printf("%s\n", targetProcess.c_str());
-  const DWORD fileMapRead = 0x0004; // FILE_MAP_READ
-
-  hMapFile = OpenFileMappingW(fileMapRead, FALSE, L"RTSSSharedMemoryV2");
-  if (!hMapFile) {
-    fprintf(stderr, "Could not open RTSS Shared Memory. Is "
-                    "RivaTuner Statistics Server running?");
-    exit(1);
-  }
-
-  pMapAddr = MapViewOfFile(hMapFile, fileMapRead, 0, 0, 0);
-  if (!pMapAddr) {
-    CloseHandle(hMapFile);
-    fprintf(stderr, "Failed to map view of shared memory.");
-    exit(1);
-  }
-  processEntryAddress = 0;
-}
-
-std::optional<double> getRawFrametime() {
-  char *base = static_cast<char *>(pMapAddr);
-
-  if (processEntryAddress != 0) {
-    DWORD rawFrametime =
-        *reinterpret_cast<DWORD *>(processEntryAddress + frametimeMemoryOffset);
-    return static_cast<double>(rawFrametime) / 1000.0;
-  } else {
-    DWORD dwAppEntrySize = *reinterpret_cast<DWORD *>(base + 8);
-    DWORD dwAppArrOffset = *reinterpret_cast<DWORD *>(base + 12);
-    DWORD dwAppArrSize = *reinterpret_cast<DWORD *>(base + 16);
-
-    for (DWORD i = 0; i < dwAppArrSize; ++i) {
-      uintptr_t entryBaseAddr = reinterpret_cast<uintptr_t>(base) +
-                                dwAppArrOffset + (i * dwAppEntrySize);
-
-      char *appNamePtr = reinterpret_cast<char *>(entryBaseAddr + 4);
-      std::string applicationName(appNamePtr);
-
-      if (applicationName.find(targetProcess) != std::string::npos) {
-        processEntryAddress = entryBaseAddr;
+// Key events come from the low-level hook and go through the router
+static KeySource::HookSource keySource;
+static HookDispatch::Router keyRouter(foregroundTracker);
+static Telemetry::Writer telemetry;
+
+// Everything the hook needs to look keybinds up. Reloading the macro file
+// builds a whole new one off the hook thread and the router swaps the
+// pointer, the hook never waits on a lock.
+struct KeybindTable {
+  HookDispatch::Dispatcher dispatcher;
+  std::vector<MacroFile::Entry> entries; // empty for the built in ones
+  KeybindTable *replaces = nullptr;      // until a reload has swapped it out
+};
 
-        DWORD rawFrametime = *reinterpret_cast<DWORD *>(processEntryAddress +
-                                                        frametimeMemoryOffset);
-        return static_cast<double>(rawFrametime) / 1000.0;
-      }
+// The table the router has. Only the watcher thread touches it once that runs.
+static KeybindTable *keybinds = nullptr;
+
+// Queues the program when its lane is free. It runs times times, or over and
+// over until the key is let go with Keybinds::whileHeld.
+static std::function<void()> queueMacro(const Macro::Program *program, int lane,
+                                        int keyCode, uint32_t times) {
+  return [program, lane, keyCode, times]() {
+    if (InputHandler::lanes[lane].empty()) {
+      InputHandler::queueTask(
+          times == Keybinds::whileHeld
+              ? InputHandler::Task::runWhileHeld(program, keyCode)
+              : InputHandler::Task::run(program, times),
+          lane);
     }
-  }
-  return std::nullopt;
+  };
 }
 
-} // namespace RTSSReader
-
-namespace InputHandler {
-void queueTask(int delay, std::optional<std::function<void()>> function,
-               bool recursive);
-std::optional<WORD> findKey(const std::string &keyToFind);
-
-struct Task {
-  int delay;
-  std::optional<std::function<void()>> function;
-  bool recursive;
-};
-void queueTask(Task task);
-void queueInputs(std::vector<std::string> inputs,
-                 std::function<void()> callback = nullptr);
-extern std::queue<Task> queuedTasks;
-} // namespace InputHandler
-
 class Keybind {
 public:
+  // Pressing it again while its lane is still busy does nothing
   Keybind(int keyCode, std::function<void()> function,
-          std::vector<std::string> modifiers = {}) {
+          std::vector<std::string> modifiers = {}, int lane = 0) {
     this->keyCode = keyCode;
-    this->isPressed = false;
     this->modifiers = modifiers;
-    this->function = [function]() {
-      if (InputHandler::queuedTasks.empty()) {
-        InputHandler::queueTask(0, function, false);
+    this->lane = lane;
+    this->function = [function, lane]() {
+      if (InputHandler::lanes[lane].empty()) {
+        // Copying a std::function holding a capture-less lambda doesn't allocate
+        InputHandler::queueTask(InputHandler::Task::call(function, false), lane);
       }
     };
-    keybinds.push_back(*this);
+    registerKeybind();
   }
 
   Keybind(const std::string &key, std::function<void()> function,
-          std::vector<std::string> modifiers = {})
+          std::vector<std::string> modifiers = {}, int lane = 0)
       : Keybind(InputHandler::findKey(key).value(), function,
-                modifiers) { // This should always have a value
+                modifiers, lane) { // This should always have a value
   }
 
-  static std::vector<Keybind> keybinds;
-  bool isPressed;
-  DWORD keyCode;
-  std::function<void()> function;
-  std::vector<std::string> modifiers;
-};
-
-std::vector<Keybind> Keybind::keybinds = {};
-
-namespace InputHandler {
-
-bool getPhysicalKeyState(WORD vkCode) {
-  for (Keybind &keybind : Keybind::keybinds) {
-    if (vkCode == keybind.keyCode) {
-      return keybind.isPressed;
-    }
-  }
-  // Return Windows API KeyState if there is no keybind with that keycode.
-  return (GetAsyncKeyState(vkCode) & 0x8000) != 0;
-}
-
-std::optional<WORD> findKey(const std::string &keyToFind) {
-  std::string lowerCaseKey = keyToFind;
-  std::transform(lowerCaseKey.begin(), lowerCaseKey.end(), lowerCaseKey.begin(),
-                 [](unsigned char c) { return std::tolower(c); });
-
-  std::optional<WORD> vkCode;
-  for (size_t i = 0; i < g_key_to_vk_size; ++i) {
-    if (g_key_to_vk[i].keyName == lowerCaseKey) {
-      vkCode = g_key_to_vk[i].vkCode;
-      break;
-    }
-  }
-
-  if (!vkCode.has_value()) {
-    SHORT vk = VkKeyScan(lowerCaseKey[0]);
-    if (vk == -1) {
-      printf("Failed to find keycode for: %s", lowerCaseKey.c_str());
-      return std::nullopt;
-    }
-    vkCode = LOBYTE(vk);
-  }
-  return vkCode;
-}
-
-void sendKeyInput(WORD vkCode, bool pressDown) {
-  INPUT input = {0};
-  // add specific handling for mousewheel cause i was really lazy
-  if (vkCode == 0x1001 || vkCode == 0x1000) {
-    input.type = INPUT_MOUSE;
-    input.mi.dwFlags = MOUSEEVENTF_WHEEL;
-    input.mi.mouseData = (vkCode == 0x1001) ? WHEEL_DELTA : -WHEEL_DELTA;
-    input.mi.time = 0;
-    input.mi.dwExtraInfo = 0;
-    SendInput(1, &input, sizeof(INPUT));
-    input.mi.mouseData = 0;
-    SendInput(1, &input, sizeof(INPUT));
-  } else {
-    input.type = INPUT_KEYBOARD;
-
-    input.ki.wVk = vkCode;
-    input.ki.wScan = MapVirtualKey(vkCode, MAPVK_VK_TO_VSC);
-    input.ki.time = 0;
-    input.ki.dwExtraInfo = 0;
-    input.ki.dwFlags = KEYEVENTF_SCANCODE;
-
-    switch (
-        vkCode) { // For some keycodes you need to add this flag or something
-    case VK_UP:
-    case VK_DOWN:
-    case VK_LEFT:
-    case VK_RIGHT:
-    case VK_HOME:
-    case VK_END:
-    case VK_PRIOR:
-    case VK_NEXT:
-    case VK_INSERT:
-    case VK_DELETE:
-    case VK_LCONTROL:
-    case VK_RCONTROL:
-    case VK_LSHIFT:
-    case VK_RSHIFT:
-    case VK_LMENU:
-    case VK_RMENU:
-    case VK_APPS:
-      input.ki.dwFlags |= KEYEVENTF_EXTENDEDKEY;
-      break;
-    }
-
-    if (!pressDown) {
-      input.ki.dwFlags |= KEYEVENTF_KEYUP;
+  // Macro keybind, the inputs are compiled here once and pressing the key just
+  // queues the finished program
+  Keybind(int keyCode, std::span<const Macro::Input> inputs,
+          std::vector<std::string> modifiers = {}, int lane = 0,
+          uint32_t times = 1) {
+    this->keyCode = keyCode;
+    this->modifiers = modifiers;
+    this->lane = lane;
+    const Macro::Program *program =
+        Macro::compileOrReport("for key " + std::to_string(keyCode), inputs);
+    if (program == nullptr) {
+      return;
     }
-    SendInput(1, &input, sizeof(INPUT));
+    this->function = queueMacro(program, lane, keyCode, times);
+    registerKeybind();
   }
-}
-
-std::queue<Task> queuedTasks = {};
-std::mutex queuedTasksMutex;
 
-void queueTask(Task task) {
-  std::lock_guard<std::mutex> lock(queuedTasksMutex);
-  queuedTasks.push(task);
-}
+  Keybind(int keyCode, std::initializer_list<Macro::Input> inputs,
+          std::vector<std::string> modifiers = {}, int lane = 0)
+      : Keybind(keyCode, std::span<const Macro::Input>(inputs.begin(), inputs.size()),
+                modifiers, lane) {}
 
-void queueTask(int delay, std::optional<std::function<void()>> function,
-               bool recursive) {
-  std::lock_guard<std::mutex> lock(queuedTasksMutex);
-  queuedTasks.push({delay, function, recursive});
-}
+  Keybind(std::string_view key, std::initializer_list<Macro::Input> inputs,
+          std::vector<std::string> modifiers = {}, int lane = 0)
+      : Keybind(InputHandler::findKey(key).value(), inputs, modifiers, lane) {}
 
-void queueInput(WORD vkCode, std::optional<bool> state, bool recursive) {
-  auto enqueue = [&](bool press, bool recursiveInput) {
-    queueTask(
-        0,
-        [vkCode, press]() {
-          sendKeyInput(vkCode, press);
-          printf("%.3f sending %hu, state: %d\n",
-                 std::chrono::duration<double, std::milli>(
-                     std::chrono::steady_clock::now().time_since_epoch())
-                     .count(),
-                 vkCode, press);
-        },
-        recursiveInput);
-  };
-
-  if (state.has_value()) {
-    enqueue(state.value(), recursive);
-  } else {
-    enqueue(true, false);
-    enqueue(false, recursive);
-  }
-}
+  static KeybindTable *table; // the one keybinds get added to
+  DWORD keyCode;
+  std::function<void()> function;
+  std::vector<std::string> modifiers;
+  int lane;
 
-std::regex inputPattern(R"((\w+?)(?:\s(down|up|\d+))?(R)?)");
-void queueInputs(std::vector<std::string> inputs,
-                 std::function<void()> callback) {
-  for (size_t i = 0; i < inputs.size(); ++i) {
-    const std::string &input = inputs[i];
-    std::smatch matches;
-    if (!std::regex_match(input, matches, inputPattern)) {
+private:
+  // Modifier names are resolved here so the hook never sees a string
+  void registerKeybind() {
+    // Wheel codes and the like, the hook only routes real keys
+    if (keyCode > 0xFF) {
+      fprintf(stderr, "Keybind for key %lu: not a keyboard key\n", (unsigned long)keyCode);
       return;
     }
-    std::string inputName = matches[1];
-    std::string secondArg = matches[2];
-    bool isRecursive = matches[3].matched;
-
-    std::optional<bool> state = std::nullopt;
-    int amount = 1;
-    if (matches[2].matched) {
-      if (secondArg == "down") {
-        state = true;
-      } else if (secondArg == "up") {
-        state = false;
-      } else if (!secondArg.empty() &&
-                 std::all_of(secondArg.begin(), secondArg.end(), ::isdigit)) {
-        amount = std::stoi(secondArg);
-      }
+    if (lane < 0 || lane >= InputHandler::maxLanes) {
+      fprintf(stderr, "Keybind for key %lu: no lane %d\n", (unsigned long)keyCode, lane);
+      return;
     }
-
-    WORD vkCode;
-    if (inputName == "sleep") {
-      for (int i = 0; i < amount; i++) {
-        queueTask(0, std::nullopt, isRecursive);
-      }
-      continue;
-    } else {
-      std::optional<WORD> keyOpt = findKey(inputName);
-      if (!keyOpt.has_value()) {
+    std::vector<uint16_t> modifierCodes;
+    for (const std::string &modifier : modifiers) {
+      std::optional<uint16_t> vkCode = InputHandler::findKey(modifier);
+      if (!vkCode.has_value()) {
+        fprintf(stderr, "Keybind for key %lu: unknown modifier %s\n",
+                (unsigned long)keyCode, modifier.c_str());
         return;
       }
-      vkCode = keyOpt.value();
-
-      printf("Key code for '%s': %hd\n", input.c_str(), vkCode);
-    }
-
-    if (inputName == "wheelup" || inputName == "wheeldown") {
-      queueInput(vkCode, true, false);
-      queueTask(0, std::nullopt, false);
-      continue;
-    }
-
-    // Schizo up and down logic because it is faster
-    /*
-    if ((inputName == "up" || inputName == "down") && amount != 1 &&
-        !state.has_value()) {
-      WORD wheelInput = findKey("wheel" + inputName).value();
-      for (int i = 0; i < floor(amount / 2); i++) {
-        queueInput(vkCode, true, false);
-        queueInput(vkCode, false, true);
-        queueInput(wheelInput, false, false);
-        if (amount >= 3) {
-          queueTask(0, std::nullopt, false);
-        }
-      }
-      if (amount & 1) {
-        queueInput(vkCode, true, false);
-        queueInput(vkCode, false, true);
-      }
-      continue;
+      modifierCodes.push_back(vkCode.value());
     }
-      */
-
-    for (int i = 0; i < amount; i++) {
-      queueInput(vkCode, state, isRecursive);
+    if (!table->dispatcher.add((uint16_t)keyCode, modifierCodes, function)) {
+      fprintf(stderr, "Keybind for key %lu: too many modifiers\n",
+              (unsigned long)keyCode);
     }
   }
-  if (callback) {
-    queueTask(0, callback, true);
-  }
-}
+};
 
-class TaskExecutor {
-public:
-  ~TaskExecutor() {
-    if (worker.joinable()) {
-      {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        stop_thread = true;
-      }
-      condition.notify_one();
-      worker.join();
-    }
-  }
+KeybindTable *Keybind::table = nullptr;
 
-  void start() { worker = std::thread(&TaskExecutor::loop, this); }
+namespace InputHandler {
 
-  void enqueue(std::function<void()> task) {
-    {
-      std::unique_lock<std::mutex> lock(queue_mutex);
-      if (stop_thread) {
-        return;
-      }
-      tasks.push(std::move(task));
-    }
-    condition.notify_one();
+bool getPhysicalKeyState(WORD vkCode) {
+  if (vkCode > 0xFF) {
+    return false;
   }
+  return keyRouter.keys.get(vkCode);
+}
 
-private:
-  void loop() {
-    while (true) {
-      std::function<void()> task;
-      {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        condition.wait(lock, [this] { return !tasks.empty() || stop_thread; });
-
-        if (stop_thread && tasks.empty()) {
-          return;
-        }
-
-        task = std::move(tasks.front());
-        tasks.pop();
-      }
+} // namespace InputHandler
 
-      task();
+KeybindTable *builtInKeybinds() { // Add keybinds here
+  // The macros themselves are in keybinds.h so the simulator can run them
+  Keybind::table = new KeybindTable;
+  for (const Keybinds::MacroKeybind &macro : Keybinds::macros) {
+    std::vector<std::string> modifiers;
+    if (macro.modifier != nullptr) {
+      modifiers.push_back(macro.modifier);
     }
+    Keybind(macro.vkCode, macro.inputs, modifiers, macro.lane, macro.times);
   }
+  return std::exchange(Keybind::table, nullptr);
+}
 
-  std::thread worker;
-  std::queue<std::function<void()>> tasks;
-  std::mutex queue_mutex;
-  std::condition_variable condition;
-  bool stop_thread = false;
-};
-
-void executeFirstQueuedTask() {
-  while (true) {
-    Task firstTaskCopy;
-    {
-      std::lock_guard<std::mutex> lock(queuedTasksMutex);
-      if (queuedTasks.empty()) {
-        break;
-      }
-      Task &firstTaskReference = queuedTasks.front();
-      if (--firstTaskReference.delay < 0) {
-        firstTaskCopy = firstTaskReference;
-        queuedTasks.pop();
+static const char *macroPath = "macros.txt";
+
+// Null if the file is missing or has errors, those get printed
+static KeybindTable *loadMacroFile(const KeybindTable *previous) {
+  std::vector<MacroFile::Entry> entries;
+  std::vector<MacroFile::Error> errors;
+  if (!MacroFile::load(macroPath, previous == nullptr ? nullptr : &previous->entries,
+                       entries, errors)) {
+    for (const MacroFile::Error &error : errors) {
+      if (error.line == 0) {
+        fprintf(stderr, "%s\n", error.message.c_str());
       } else {
-        break;
+        fprintf(stderr, "%s:%zu: %s\n", macroPath, error.line, error.message.c_str());
       }
     }
-    if (firstTaskCopy.function.has_value()) {
-      firstTaskCopy.function.value()();
-    }
-    if (!firstTaskCopy.recursive) {
-      break;
+    return nullptr;
+  }
+  KeybindTable *table = new KeybindTable;
+  for (const MacroFile::Entry &entry : entries) {
+    if (!table->dispatcher.add(entry.vkCode, entry.modifiers,
+                               queueMacro(entry.program, entry.lane, entry.vkCode,
+                                          entry.times))) {
+      fprintf(stderr, "%s: %s has too many modifiers\n", macroPath, entry.key.c_str());
     }
   }
+  table->entries = std::move(entries);
+  return table;
 }
-} // namespace InputHandler
-
-void addKeybinds() { // Add keybinds here
-  // You can't type this keycode as a string so i just typed in the virtual
-  // keycode of it instead
-  new Keybind(220, []() {
-    InputHandler::queueInputs({"mR", "enter down", "enter up", "enter downR",
-                               "down 4", "enter up", "enter downR", "down down",
-                               "enter up", "down up"});
-  });
-
-  new Keybind("F2", []() {
-    InputHandler::queueInputs({"mR", "enter down", "up 7", "enter up", "enter",
-                               "sleep", "enter", "enter downR", "up down",
-                               "enter up", "up up", "m"});
-  });
 
-  new Keybind(221,
-              []() {
-                InputHandler::queueInputs(
-                    {"mR", "enter down", "up 6", "enter up", "down downR",
-                     "enter down", "down up", "enter upR", "sleep 2",
-                     "space downR", "m down", "m upR", "space up"});
-              },
-              {"shift"});
-
-  new Keybind(186,
-              []() {
-                InputHandler::queueInputs(
-                    {"mR", "enter down", "up 7", "enter up", "down downR",
-                     "enter down", "down up", "down", "enter up"});
-              },
-              {"shift"});
-
-  /*
-  Why is this so fucking inconsistent?
-  new Keybind("F6", []() {
-    auto work_loop = [](auto &self) -> void {
-      InputHandler::queueInputs(
-          {"enter downR", "t", "hR", "eR", "lR", "lR", "o", "enter up"},
-          [&self]() {
-            std::optional<WORD> keyCode = InputHandler::findKey("F6");
-
-            if (InputHandler::getPhysicalKeyState(keyCode.value())) {
-
-              printf("requeuing");
-              InputHandler::queueTask(0, [&self]() { self(self); }, true);
-            }
-          });
-    };
-
-    work_loop(work_loop);
-  });
-  */
+// On the watcher thread. A broken file keeps the old macros.
+static void reloadMacroFile() {
+  FrameSource::Clock::time_point start = FrameSource::Clock::now();
+  KeybindTable *table = loadMacroFile(keybinds);
+  if (table == nullptr) {
+    fprintf(stderr, "keeping the old macros\n");
+    return;
+  }
+  table->replaces = std::exchange(keybinds, table);
+  // The hook runs on the key source's thread, swapping from there means the
+  // old table isn't in the middle of an event and its held keys can be read
+  keySource.post(
+      [](void *argument) {
+        KeybindTable *table = (KeybindTable *)argument;
+        keyRouter.replace(&table->dispatcher);
+        delete std::exchange(table->replaces, nullptr);
+      },
+      table);
+  printf("reloaded %zu macros from %s in %.2fms\n", table->entries.size(), macroPath,
+         std::chrono::duration<double, std::milli>(FrameSource::Clock::now() - start)
+             .count());
 }
 
-HHOOK keyboardHook;
-BYTE keybindKeyState[] = {0};
-
-LRESULT CALLBACK onKeyPress(int nCode, WPARAM wParam, LPARAM lParam) {
-  if (nCode == HC_ACTION) {
-    KBDLLHOOKSTRUCT *pKeyBoard = (KBDLLHOOKSTRUCT *)lParam;
-
-    // Check if the key event was injected (sent by SendInput() or something
-    // idfk how this works bro
-    if (pKeyBoard->flags & LLKHF_INJECTED ||
-        getActiveProcessName() != RTSSReader::targetProcess) {
-      return CallNextHookEx(keyboardHook, nCode, wParam, lParam);
+static MacroFile::Watcher macroWatcher;
+
+static Trace::Exporter traceExporter(InputHandler::traceRecorder);
+
+// Every running copy of the game gets its own frame clock, steps follow
+// whichever one is focused
+static FrameSource::RTSSSource frameSource(&foregroundTracker.focusedProcessId);
+
+// Ctrl+C prints how long frames took to turn into inputs before exiting
+BOOL WINAPI onConsoleControl(DWORD controlType) {
+  if (controlType == CTRL_C_EVENT || controlType == CTRL_CLOSE_EVENT) {
+    traceExporter.stop(); // also finishes the trace file
+    telemetry.close();    // so the next run can take the segment over right away
+    traceExporter.summary().print(stdout);
+    const FrameGen::Stats &frameGen = InputHandler::frameGen.stats();
+    printf("frame generation x%d (%s, confidence %.2f), %llu of %llu frames "
+           "rendered, changed %llu times\n",
+           frameGen.multiplier, FrameGen::sourceName(frameGen.source),
+           frameGen.confidence, (unsigned long long)frameGen.realFrames,
+           (unsigned long long)frameGen.frames,
+           (unsigned long long)frameGen.multiplierChanges);
+    if (InputHandler::timingMode == InputHandler::TimingMode::Predicted) {
+      printf("%llu steps at predicted times, %llu on detection, period %.3fms, "
+             "spread %.3fms, resynced %llu times\n",
+             (unsigned long long)InputHandler::timingStats.predictedSteps,
+             (unsigned long long)InputHandler::timingStats.detectedSteps,
+             InputHandler::framePredictor.periodMs(),
+             InputHandler::framePredictor.spreadMs(),
+             (unsigned long long)InputHandler::framePredictor.resyncs);
     }
-    switch (wParam) {
-
-    case WM_KEYDOWN:
-    case WM_SYSKEYDOWN: {
-      // lParam is a pointer to a KBDLLHOOKSTRUCT
-      KBDLLHOOKSTRUCT *pKeyBoard = (KBDLLHOOKSTRUCT *)lParam;
-      DWORD vkCode = pKeyBoard->vkCode;
-
-      for (Keybind &keybind : Keybind::keybinds) {
-        bool modifiersPressed =
-            keybind.modifiers.size() != 0 // Holy fucking auto formatter
-                ? std::all_of(
-                      keybind.modifiers.begin(), keybind.modifiers.end(),
-                      [](std::string modifier) {
-                        std::optional<WORD> key =
-                            InputHandler::findKey(modifier);
-                        return InputHandler::getPhysicalKeyState(key.value());
-                      })
-                : true;
-        if (vkCode == keybind.keyCode && !keybind.isPressed &&
-            modifiersPressed) {
-          keybind.isPressed = true;
-          keybind.function();
-          return 1;
-        }
-      }
-      // printf("Key Down: %lu\n", vkCode);
-      break;
+    FrameStats::Summary pacing = InputHandler::frameStats.overall();
+    printf("frametimes over the last %u frames: p50 %.2fms p95 %.2fms p99 %.2fms "
+           "max %.2fms, worst ever %.2fms, %llu hitches",
+           pacing.frames, pacing.p50, pacing.p95, pacing.p99, pacing.max,
+           InputHandler::frameStats.maxMs(), (unsigned long long)InputHandler::frameStats.hitches);
+    if (InputHandler::holdOnHitch) {
+      printf(", held steps on %llu frames", (unsigned long long)InputHandler::timingStats.heldSteps);
     }
-
-    case WM_KEYUP:
-    case WM_SYSKEYUP: {
-      KBDLLHOOKSTRUCT *pKeyBoardUp = (KBDLLHOOKSTRUCT *)lParam;
-      DWORD vkCode = pKeyBoardUp->vkCode;
-      for (Keybind &keybind : Keybind::keybinds) {
-        if (vkCode == keybind.keyCode) {
-          keybind.isPressed = false;
-          return 1;
-        }
+    printf("\n");
+    printf("%llu inputs dropped for a key another lane was holding\n",
+           (unsigned long long)InputHandler::keyConflicts);
+    for (int i = 0; i < RTSSReader::maxInstances; i++) {
+      const FrameSource::RTSSSource::InstanceClock &clock = frameSource.clocks()[i];
+      if (clock.processId != 0) {
+        printf("instance %lu%s: %llu frames, last frametime %.3fms\n",
+               (unsigned long)clock.processId,
+               clock.processId == frameSource.activeProcessId() ? " (active)" : "",
+               (unsigned long long)clock.frames, clock.frametime);
       }
-      // printf("Key Up: %lu\n", vkCode);
-      break;
-    }
     }
+    printf("switched instances %llu times\n", (unsigned long long)frameSource.switches);
+    InputHandler::inputLatency[(int)InputHandler::ExecutionMode::Inline].print(
+        stdout, "frame to input, inline");
+    InputHandler::inputLatency[(int)InputHandler::ExecutionMode::Executor].print(
+        stdout, "frame to input, executor");
+    fflush(stdout);
   }
-  return CallNextHookEx(keyboardHook, nCode, wParam, lParam);
+  return FALSE; // let the default handler exit
 }
 
-double previousFrametime = 0;
-int frameGenMultiplier =
-    1; // For DLSS Frame Generation. This is completely fucking broken btw who
-       // made this shitty application?
-int framesDetected = 0;
-static InputHandler::TaskExecutor taskExecutor;
-LARGE_INTEGER lastGenerated;
+// --executor    run frame tasks on the executor thread like before
+// --cpu <n>     core to pin the frame thread to, -1 to not pin. Defaults to
+//               the last one, games tend to keep their main threads low.
+// --trace <f>   write every frame/task/input timestamp to f, CSV if it ends
+//               in .csv and binary otherwise
+// --capture <f> record the game's RTSS entry to f for fakertss replay
+// --framegen <n> frame generation multiplier, detected if not given
+// --predict <ms> send each step this far into the frame it's predicted for
+//               instead of when the frame is noticed, see scheduler.h
+// --hitch-hold  don't run steps on frames right after the game hitched
+// --macros <f>  macro file, macros.txt by default. Reloaded whenever it's
+//               saved, the ones in keybinds.h are used if it doesn't exist.
+// --no-telemetry don't publish live state for the monitor, see telemetry.h
+int main(int argc, char **argv) {
+  int frameThreadCpu = (int)std::thread::hardware_concurrency() - 1;
+  const char *tracePath = nullptr;
+  const char *capturePath = nullptr;
+  bool publishTelemetry = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--executor") == 0) {
+      InputHandler::executionMode = InputHandler::ExecutionMode::Executor;
+    } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+      frameThreadCpu = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+      capturePath = argv[++i];
+    } else if (strcmp(argv[i], "--framegen") == 0 && i + 1 < argc) {
+      InputHandler::frameGen.setForced(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--predict") == 0 && i + 1 < argc) {
+      InputHandler::timingMode = InputHandler::TimingMode::Predicted;
+      InputHandler::predictedOffsetMs = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--hitch-hold") == 0) {
+      InputHandler::holdOnHitch = true;
+    } else if (strcmp(argv[i], "--macros") == 0 && i + 1 < argc) {
+      macroPath = argv[++i];
+    } else if (strcmp(argv[i], "--no-telemetry") == 0) {
+      publishTelemetry = false;
+    }
+  }
+  if (publishTelemetry) {
+    if (telemetry.open()) {
+      InputHandler::telemetry = &telemetry;
+      keyRouter.telemetry = &telemetry;
+    } else {
+      fprintf(stderr, "couldnt publish telemetry, is another copy running?\n");
+    }
+  }
+  if (!traceExporter.start(tracePath)) {
+    fprintf(stderr, "couldnt open trace file %s\n", tracePath);
+    return 1;
+  }
+  SetConsoleCtrlHandler(onConsoleControl, TRUE);
 
-int main() {
   if (!SetPriorityClass(GetCurrentProcess(), ABOVE_NORMAL_PRIORITY_CLASS)) {
     fprintf(stderr, "why cant i set priorirtyt fck bro");
     return 1;
   }
-  keyboardHook =
-      SetWindowsHookEx(WH_KEYBOARD_LL, onKeyPress, GetModuleHandle(NULL), 0);
+  keybinds = loadMacroFile(nullptr);
+  if (keybinds == nullptr) {
+    fprintf(stderr, "using the macros in keybinds.h\n");
+    keybinds = builtInKeybinds();
+  }
+  keyRouter.swap(&keybinds->dispatcher);
 
-  if (keyboardHook == NULL) {
+  if (!keySource.start(keyRouter)) {
     fprintf(stderr, "why cant i install the hook");
     return 1;
   }
-  RTSSReader::initialize();
-  addKeybinds();
+  // Reloads post the old table to the key source, so not before it started
+  macroWatcher.start(macroPath, reloadMacroFile);
+  // Doesn't wait for the game or RTSS, whichever is missing gets picked up
+  // once it starts. The hook only needs to know which game to check focus for.
+  static Process::WindowsProbe processProbe;
+  RTSSReader::startWatching(processProbe, [](std::string_view game) {
+    // The names are knownTargets' literals, so null terminated
+    keySource.post(
+        [](void *name) { foregroundTracker.setTarget(name != nullptr ? (const char *)name : ""); },
+        game.empty() ? nullptr : (void *)game.data());
+  });
+  if (capturePath != nullptr && !RTSSReader::startCapture(capturePath)) {
+    fprintf(stderr, "couldnt open capture file %s\n", capturePath);
+    return 1;
+  }
+  InputHandler::isKeyHeld = [](uint16_t vkCode) {
+    return InputHandler::getPhysicalKeyState(vkCode);
+  };
+
+  static OutputSink::SendInputSink sendInputSink;
+  InputHandler::outputSink = &sendInputSink;
+
+  // Out of context events get delivered through keySource.run below, on
+  // the same thread as the hook, so the tracker needs no locking
+  HWINEVENTHOOK foregroundHook = SetWinEventHook(
+      EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+      onForegroundChanged, 0, 0, WINEVENT_OUTOFCONTEXT);
+  if (foregroundHook == NULL) {
+    // Not fatal, the hook still compares the foreground window itself
+    fprintf(stderr, "couldnt hook foreground changes\n");
+  }
+  foregroundTracker.onForegroundChanged(
+      reinterpret_cast<Foreground::Window>(GetForegroundWindow()));
 
-  std::thread([]() {
-    taskExecutor.start();
+  // The hook only tracks keys from now on, pick up whatever is already held
+  for (int vkCode = 1; vkCode <= 0xFF; vkCode++) {
+    if (GetAsyncKeyState(vkCode) & 0x8000) {
+      keyRouter.keys.set(vkCode, true);
+    }
+  }
+
+  std::thread([frameThreadCpu]() {
+    InputHandler::taskExecutor.start();
     timeBeginPeriod(1);
-    while (true) {
-      double frametime = RTSSReader::getRawFrametime().value_or(0);
-      if (frametime !=
-          previousFrametime) { // This doesn't work if you set an FPS cap
-                               // using RTSS but I couldn't find another way
-                               // to do it so fuck it, this literally relies
-                               // on frametime variance it's really funny
-        previousFrametime = frametime;
-        if (RTSSReader::targetProcess != "GTA5_Enhanced.exe" ||
-            ++framesDetected == frameGenMultiplier) {
-          // LARGE_INTEGER currentTime, freq;
-          // QueryPerformanceFrequency(&freq);
-          // QueryPerformanceCounter(&currentTime);
-          // printf("new frame, last frame was generated %fms ago\n",
-          //        (currentTime.QuadPart - lastGenerated.QuadPart) * 1000.0 /
-          //            freq.QuadPart);
-          // QueryPerformanceCounter(&lastGenerated);
-          framesDetected = 0;
-          taskExecutor.enqueue(
-              InputHandler::executeFirstQueuedTask); // Do this asynchronously
-        }
-      }
 
-      // If there are currently queued tasks I want to check as often as
-      // possible to check for FrameTime updates. This is incredibly bad for
-      // the CPU but we should be doing it for very short time periods so it
-      // should be OK.
-      if (InputHandler::queuedTasks.empty()) {
-        Sleep(1);
+    // Inline mode sends inputs from this thread, don't let it get preempted
+    // or migrated right when a frame comes in
+    if (InputHandler::executionMode == InputHandler::ExecutionMode::Inline) {
+      if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST)) {
+        fprintf(stderr, "couldnt raise the frame thread priority\n");
+      }
+      if (frameThreadCpu >= 0 && frameThreadCpu < 64 &&
+          SetThreadAffinityMask(GetCurrentThread(), 1ull << frameThreadCpu) == 0) {
+        fprintf(stderr, "couldnt pin the frame thread to cpu %d\n", frameThreadCpu);
       }
     }
+
+    // New frames come from RTSS's per-frame counter, the waiter sleeps
+    // through most of each frame and only spins right before the next one
+    // is due so a queued macro doesn't cost a whole core anymore.
+    // With --predict onTick says when the next step is due and the waiter
+    // spins up to it.
+    static FrameSource::Engine engine(
+        frameSource,
+        [](const FrameSource::Frame &frame) { InputHandler::onFrame(frame); },
+        []() { return InputHandler::tasksQueued(); },
+        [](FrameSource::Clock::time_point now) { return InputHandler::onTick(now); });
+    engine.run();
   }).detach();
 
-  MSG msg;
-  while (GetMessage(&msg, NULL, 0, 0)) {
-    TranslateMessage(&msg);
-    DispatchMessage(&msg);
-  }
+  keySource.run();
 
-  UnhookWindowsHookEx(keyboardHook);
+  if (foregroundHook != NULL) {
+    UnhookWinEvent(foregroundHook);
+  }
+  macroWatcher.stop();
+  RTSSReader::stopWatching();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+// Prints what the tool publishes in its telemetry segment (telemetry.h).
+// Only maps the segment, so it can run as often as it likes without the tool
+// noticing.
+//
+//   monitor [interval ms]     a line every interval, 250 by default. Waits
+//                             for the tool to start and picks it up again
+//                             if it restarts.
+//   monitor once              one line, 1 if nothing is publishing
+//   monitor hammer <seconds>  publish from a thread as fast as possible
+//                             while reading, and count reads that had to be
+//                             retried and ones that came back inconsistent
+#include "telemetry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace Monitor {
+using Clock = std::chrono::steady_clock;
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch())
+      .count();
+}
+
+static void printLine(Telemetry::Reader &reader) {
+  Telemetry::FrameBlock frame;
+  Telemetry::StepBlock steps;
+  Telemetry::HookBlock hook;
+  if (!reader.read(frame) || !reader.read(steps) || !reader.read(hook)) {
+    printf("writer too busy, skipped\n");
+    return;
+  }
+  printf("frame %llu %.2fms (p50 %.2f p99 %.2f, %llu missed, %llu hitches) queued %u",
+         (unsigned long long)frame.index, frame.frametimeMs, frame.p50Ms, frame.p99Ms,
+         (unsigned long long)frame.missed, (unsigned long long)frame.hitches, frame.queued);
+  for (int lane = 0; lane < Telemetry::maxLanes; lane++) {
+    const Telemetry::LaneState &state = steps.lanes[lane];
+    if (state.queued == 0) {
+      continue;
+    }
+    printf(" | lane %d ", lane);
+    if (state.macro[0] != '\0' || state.steps != 0) {
+      printf("%.*s %u/%u", (int)sizeof(state.macro), state.macro, state.step, state.steps);
+      if (state.repeating == UINT32_MAX) {
+        printf(" held");
+      } else if (state.repeating != 0) {
+        printf(" +%u", state.repeating);
+      }
+    }
+    if (state.queued > 1) {
+      printf(" (%u queued)", state.queued);
+    }
+  }
+  printf(" | input %.1fus | hook %.1fus max %.1fus, %llu keys %llu eaten",
+         steps.lastLatencyNs / 1000.0, hook.lastDispatchNs / 1000.0, hook.maxDispatchNs / 1000.0,
+         (unsigned long long)hook.events, (unsigned long long)hook.eaten);
+  if (frame.updatedNs != 0) {
+    printf(" | %.0fms ago", (nowNs() - frame.updatedNs) / 1e6);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+int watch(int intervalMs, bool once) {
+  Telemetry::Reader reader;
+  bool waiting = false;
+  while (true) {
+    // The writer unlinks its segment when it goes away, look for a new one
+    // whenever the one we have is gone
+    if (reader.isOpen() && reader.header().signature != Telemetry::signature) {
+      reader.close();
+    }
+    if (!reader.isOpen() && !reader.open()) {
+      if (once) {
+        fprintf(stderr, "nothing is publishing %s\n", Telemetry::segmentName);
+        return 1;
+      }
+      if (!waiting) {
+        printf("waiting for the macro tool to start\n");
+        fflush(stdout);
+        waiting = true;
+      }
+    } else {
+      if (waiting) {
+        printf("reading telemetry of process %u\n", reader.header().processId);
+        waiting = false;
+      }
+      printLine(reader);
+      if (once) {
+        return 0;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+  }
+}
+
+// Every field of the frame block is worked out from index, a read where they
+// don't agree saw half of one write and half of another
+int hammer(double seconds) {
+  Telemetry::Writer writer;
+  if (!writer.open()) {
+    fprintf(stderr, "couldnt create %s, is something else publishing?\n", Telemetry::segmentName);
+    return 1;
+  }
+  Telemetry::Reader reader;
+  if (!reader.open()) {
+    writer.close();
+    fprintf(stderr, "couldnt map %s\n", Telemetry::segmentName);
+    return 1;
+  }
+  std::atomic<bool> running = true;
+  uint64_t writes = 0;
+  std::thread writerThread([&]() {
+    Telemetry::FrameBlock frame = {};
+    while (running.load(std::memory_order_relaxed)) {
+      frame.index++;
+      frame.missed = frame.index * 3;
+      frame.hitches = ~frame.index;
+      frame.frametimeMs = (double)frame.index;
+      frame.p50Ms = frame.frametimeMs / 2;
+      frame.p99Ms = frame.frametimeMs * 2;
+      frame.queued = (uint32_t)frame.index;
+      frame.activeLanes = (uint32_t)(frame.index >> 32);
+      frame.updatedNs = (int64_t)frame.index;
+      writer.publish(frame);
+      writes++;
+    }
+  });
+
+  uint64_t reads = 0, inconsistent = 0, lastIndex = 0, stale = 0;
+  Clock::time_point end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                               std::chrono::duration<double>(seconds));
+  while (Clock::now() < end) {
+    Telemetry::FrameBlock frame;
+    if (!reader.read(frame) || frame.index == 0) {
+      continue; // the zeroed block from before the first write doesn't fit the pattern
+    }
+    reads++;
+    uint64_t i = frame.index;
+    if (frame.missed != i * 3 || frame.hitches != ~i || frame.frametimeMs != (double)i ||
+        frame.p50Ms != (double)i / 2 || frame.p99Ms != (double)i * 2 ||
+        frame.queued != (uint32_t)i || frame.activeLanes != (uint32_t)(i >> 32) ||
+        frame.updatedNs != (int64_t)i) {
+      inconsistent++;
+    }
+    stale += i == lastIndex;
+    lastIndex = i;
+  }
+  running = false;
+  writerThread.join();
+  reader.close();
+  writer.close();
+  printf("%llu writes, %llu reads (%llu saw no new write), %llu retries, %llu gave up, "
+         "%llu inconsistent\n",
+         (unsigned long long)writes, (unsigned long long)reads, (unsigned long long)stale,
+         (unsigned long long)reader.retries, (unsigned long long)reader.tornReads,
+         (unsigned long long)inconsistent);
+  return inconsistent == 0 ? 0 : 1;
+}
+} // namespace Monitor
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "once") == 0) {
+    return Monitor::watch(0, true);
+  }
+  if (argc >= 3 && strcmp(argv[1], "hammer") == 0) {
+    return Monitor::hammer(atof(argv[2]));
+  }
+  int interval = argc >= 2 ? atoi(argv[1]) : 250;
+  if (interval <= 0) {
+    fprintf(stderr, "usage: monitor [interval ms]\n"
+                    "       monitor once\n"
+                    "       monitor hammer <seconds>\n");
+    return 1;
+  }
+  return Monitor::watch(interval, false);
+}
@@ -0,0 +1,73 @@
+#include "outputsink.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#include <cstdio>
+
+namespace OutputSink {
+
+// For some keycodes you need to add this flag or something
+static bool isExtendedKey(uint16_t vkCode) {
+  switch (vkCode) {
+  case VK_UP:
+  case VK_DOWN:
+  case VK_LEFT:
+  case VK_RIGHT:
+  case VK_HOME:
+  case VK_END:
+  case VK_PRIOR:
+  case VK_NEXT:
+  case VK_INSERT:
+  case VK_DELETE:
+  case VK_LCONTROL:
+  case VK_RCONTROL:
+  case VK_LSHIFT:
+  case VK_RSHIFT:
+  case VK_LMENU:
+  case VK_RMENU:
+  case VK_APPS:
+    return true;
+  }
+  return false;
+}
+
+void SendInputSink::submit(const Event *events, size_t count) {
+  // A wheel event is a notch followed by a zero delta, so up to two each
+  INPUT inputs[Batch::capacity * 2] = {};
+  UINT inputCount = 0;
+  for (size_t i = 0; i < count && i < Batch::capacity; i++) {
+    uint16_t vkCode = events[i].vkCode;
+    if (vkCode == 0x1001 || vkCode == 0x1000) {
+      INPUT &input = inputs[inputCount++];
+      input.type = INPUT_MOUSE;
+      input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+      input.mi.mouseData = (vkCode == 0x1001) ? WHEEL_DELTA : -WHEEL_DELTA;
+      inputs[inputCount] = input;
+      inputs[inputCount++].mi.mouseData = 0;
+      continue;
+    }
+
+    INPUT &input = inputs[inputCount++];
+    input.type = INPUT_KEYBOARD;
+    input.ki.wVk = vkCode;
+    input.ki.wScan = MapVirtualKey(vkCode, MAPVK_VK_TO_VSC);
+    input.ki.dwFlags = KEYEVENTF_SCANCODE;
+    if (isExtendedKey(vkCode)) {
+      input.ki.dwFlags |= KEYEVENTF_EXTENDEDKEY;
+    }
+    if (!events[i].press) {
+      input.ki.dwFlags |= KEYEVENTF_KEYUP;
+    }
+  }
+
+  UINT sent = SendInput(inputCount, inputs, sizeof(INPUT));
+  if (sent != inputCount) {
+    // Usually UIPI, the game runs elevated and we don't
+    fprintf(stderr, "SendInput only sent %u of %u inputs\n", sent, inputCount);
+  }
+}
+} // namespace OutputSink
+#endif
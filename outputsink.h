@@ -0,0 +1,79 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where the inputs a macro produces end up. Everything that runs in the same
+// frame is collected into one Batch and handed over in a single call, so on
+// Windows a whole "enter down", "down 4" group is one SendInput instead of
+// one syscall per key with the scheduler free to get in between.
+namespace OutputSink {
+// vkCode 0x1000/0x1001 is the wheel, same pseudo keys as the macros
+struct Event {
+  uint16_t vkCode;
+  bool press;
+};
+
+class Sink {
+public:
+  virtual ~Sink() = default;
+  virtual void submit(const Event *events, size_t count) = 0;
+};
+
+class Batch {
+public:
+  static constexpr size_t capacity = 64;
+
+  // Flushes on its own if a frame somehow has more than capacity inputs
+  void add(Sink &sink, uint16_t vkCode, bool press) {
+    if (count == capacity) {
+      flush(sink);
+    }
+    events[count++] = {vkCode, press};
+  }
+
+  void flush(Sink &sink) {
+    if (count != 0) {
+      sink.submit(events, count);
+      count = 0;
+    }
+  }
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+
+private:
+  Event events[capacity];
+  size_t count = 0;
+};
+
+#ifdef _WIN32
+class SendInputSink : public Sink {
+public:
+  void submit(const Event *events, size_t count) override;
+};
+#endif
+
+// Keeps everything it's given, with the batch it came in
+class RecordingSink : public Sink {
+public:
+  struct Recorded {
+    Event event;
+    uint64_t batch;
+  };
+
+  void submit(const Event *events, size_t count) override {
+    for (size_t i = 0; i < count; i++) {
+      recorded.push_back({events[i], batches});
+    }
+    batches++;
+  }
+
+  std::vector<Recorded> recorded;
+  uint64_t batches = 0;
+};
+} // namespace OutputSink
+
+#endif
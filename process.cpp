@@ -0,0 +1,111 @@
+#include "process.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#include <tlhelp32.h>
+#endif
+#ifdef __linux__
+#include <cstdio>
+#include <dirent.h>
+#endif
+
+namespace Process {
+
+// Better (earlier) match for name than best, or best
+static int match(std::span<const std::string_view> names, std::string_view name, int best) {
+  int end = best < 0 ? (int)names.size() : best;
+  for (int i = 0; i < end; i++) {
+    if (names[i] == name) {
+      return i;
+    }
+  }
+  return best;
+}
+
+#ifdef _WIN32
+int WindowsProbe::findRunning(std::span<const std::string_view> names) {
+  HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+  if (snapshot == INVALID_HANDLE_VALUE) {
+    return -1;
+  }
+  PROCESSENTRY32 entry;
+  entry.dwSize = sizeof(PROCESSENTRY32);
+  int best = -1;
+  for (BOOL more = Process32First(snapshot, &entry); more && best != 0;
+       more = Process32Next(snapshot, &entry)) {
+    best = match(names, entry.szExeFile, best);
+  }
+  CloseHandle(snapshot);
+  return best;
+}
+#endif
+
+#ifdef __linux__
+int ProcProbe::findRunning(std::span<const std::string_view> names) {
+  DIR *proc = opendir("/proc");
+  if (proc == nullptr) {
+    return -1;
+  }
+  int best = -1;
+  char path[300];
+  char commandLine[512];
+  while (dirent *process = readdir(proc)) {
+    if (process->d_name[0] < '0' || process->d_name[0] > '9') {
+      continue; // not a pid
+    }
+    snprintf(path, sizeof(path), "/proc/%s/cmdline", process->d_name);
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+      continue; // gone already
+    }
+    size_t length = fread(commandLine, 1, sizeof(commandLine) - 1, file);
+    fclose(file);
+    commandLine[length] = '\0';
+    // argv[0] ends at the first null, kernel threads have none at all
+    std::string_view program(commandLine);
+    size_t slash = program.find_last_of("/\\");
+    if (slash != std::string_view::npos) {
+      program.remove_prefix(slash + 1);
+    }
+    if (!program.empty()) {
+      best = match(names, program, best);
+      if (best == 0) {
+        break;
+      }
+    }
+  }
+  closedir(proc);
+  return best;
+}
+#endif
+
+void Watcher::start(Probe &probe, std::span<const std::string_view> names,
+                    std::chrono::milliseconds interval, std::function<void(int)> onPoll) {
+  stop();
+  running = true;
+  thread = std::thread([this, &probe, names = std::vector<std::string_view>(names.begin(), names.end()),
+                        interval, onPoll = std::move(onPoll)]() {
+    std::unique_lock lock(mutex);
+    while (running) {
+      lock.unlock();
+      onPoll(probe.findRunning(names));
+      lock.lock();
+      wakeUp.wait_for(lock, interval, [this]() { return !running; });
+    }
+  });
+}
+
+void Watcher::stop() {
+  {
+    std::lock_guard lock(mutex);
+    running = false;
+  }
+  wakeUp.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+} // namespace Process
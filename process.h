@@ -0,0 +1,60 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Which of the games is running. Every platform has its own way of listing
+// processes, the rest of the code only asks this.
+namespace Process {
+class Probe {
+public:
+  virtual ~Probe() = default;
+  // Index of the first of names that is running, -1 if none are. Names are
+  // executable names without a path, matched exactly. One walk over the
+  // process list no matter how many names there are.
+  virtual int findRunning(std::span<const std::string_view> names) = 0;
+};
+
+#ifdef _WIN32
+// One CreateToolhelp32Snapshot per call
+class WindowsProbe : public Probe {
+public:
+  int findRunning(std::span<const std::string_view> names) override;
+};
+#endif
+
+#ifdef __linux__
+// Walks /proc. The name is argv[0] without its path, which for games under
+// Wine/Proton is the Windows exe name, comm gets cut off at 15 characters.
+class ProcProbe : public Probe {
+public:
+  int findRunning(std::span<const std::string_view> names) override;
+};
+#endif
+// Asks a probe every interval on a thread of its own, so a slow process list
+// never holds anything else up
+class Watcher {
+public:
+  ~Watcher() { stop(); }
+  // onPoll gets what findRunning said every time, the first time right away.
+  // names is copied, the strings themselves have to stay around.
+  void start(Probe &probe, std::span<const std::string_view> names,
+             std::chrono::milliseconds interval, std::function<void(int)> onPoll);
+  void stop();
+
+private:
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool running = false;
+};
+} // namespace Process
+
+#endif
@@ -0,0 +1,353 @@
+#include "rtssreader.h"
+#include "capture.h"
+#include "process.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_PAUSE() _mm_pause()
+#else
+#define CPU_PAUSE() std::this_thread::yield()
+#endif
+
+using namespace std::chrono_literals;
+
+namespace RTSSReader {
+// Mapped once and never unmapped. The watcher thread can map it while the
+// frame thread polls, mappedSize is written before this is published.
+std::atomic<const void *> pMapAddr = nullptr;
+size_t mappedSize; // 0 if the platform doesn't tell us
+std::string targetProcess;
+
+// The watcher's pick out of watchedNames, -1 for none running. The frame
+// thread copies it into targetProcess, everything else stays on its side.
+constexpr int notWatching = -2;
+static std::atomic<int> watchedTarget = notWatching;
+// Bumped by the watcher every poll, the frame thread rescans the app array
+// when it changed so instances started since show up
+static std::atomic<uint32_t> watcherPolls = 0;
+static uint32_t appliedPolls = 0;
+static int appliedTarget = notWatching;
+static std::vector<std::string_view> watchedNames;
+static Process::Watcher processWatcher;
+uint64_t resolves = 0;
+uint64_t snapshotRetries = 0;
+uint64_t tornReads = 0;
+
+constexpr int maxSnapshotAttempts = 8;
+constexpr int retrySpins = 16; // pauses between attempts, well under a microsecond
+
+// Where each running instance of targetProcess has its entry. Only the
+// frame thread touches these.
+struct Instance {
+  uint32_t slot;
+  uint32_t processId;
+};
+static Instance instances[maxInstances];
+static int instanceCount = 0;
+static bool instancesValid = false; // false forces a rescan on the next read
+static uint32_t cachedEntrySize;
+static uint32_t cachedArrOffset;
+
+static Capture::Writer capture;
+
+bool openSharedMemory() {
+  if (pMapAddr.load(std::memory_order_acquire) != nullptr) {
+    return true;
+  }
+#ifdef _WIN32
+  const DWORD fileMapRead = 0x0004; // FILE_MAP_READ
+
+  HANDLE hMapFile = OpenFileMappingW(fileMapRead, FALSE, L"RTSSSharedMemoryV2");
+  if (!hMapFile) {
+    return false;
+  }
+
+  LPVOID view = MapViewOfFile(hMapFile, fileMapRead, 0, 0, 0);
+  if (!view) {
+    CloseHandle(hMapFile);
+    return false;
+  }
+  pMapAddr.store(view, std::memory_order_release);
+#else
+  // The POSIX stand-in (fakertss) publishes the same layout under this name
+  std::string name = std::string("/") + sharedMemoryName;
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SharedMemoryHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void *view = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+  mappedSize = info.st_size;
+  pMapAddr.store(view, std::memory_order_release);
+#endif
+  return true;
+}
+
+void startWatching(Process::Probe &probe, std::function<void(std::string_view)> onTarget,
+                   std::span<const std::string_view> names) {
+  watchedNames.assign(names.begin(), names.end());
+  processWatcher.start(
+      probe, names, 1000ms,
+      [onTarget = std::move(onTarget), last = notWatching, waitingForRTSS = false](int found) mutable {
+        if (found != last) {
+          if (found >= 0) {
+            printf("found %.*s\n", (int)watchedNames[found].size(), watchedNames[found].data());
+          } else {
+            printf(last == notWatching ? "waiting for the game to start\n"
+                                       : "game closed, waiting for it to start again\n");
+          }
+          fflush(stdout);
+          last = found;
+          watchedTarget.store(found, std::memory_order_relaxed);
+          if (onTarget) {
+            onTarget(found >= 0 ? watchedNames[found] : std::string_view());
+          }
+        }
+        watcherPolls.fetch_add(1, std::memory_order_relaxed);
+        // RTSS can start before or after the game, keep trying either way
+        if (pMapAddr.load(std::memory_order_relaxed) == nullptr) {
+          if (openSharedMemory()) {
+            printf("attached to RTSS shared memory\n");
+          } else if (!waitingForRTSS) {
+            printf("waiting for RivaTuner Statistics Server to start\n");
+          }
+          waitingForRTSS = true;
+          fflush(stdout);
+        }
+      });
+}
+
+void stopWatching() { processWatcher.stop(); }
+
+bool attached() { return pMapAddr.load(std::memory_order_relaxed) != nullptr; }
+
+const SharedMemoryHeader *getHeader() {
+  return static_cast<const SharedMemoryHeader *>(pMapAddr.load(std::memory_order_acquire));
+}
+
+static uint32_t readField(const uint32_t &field) {
+  return *static_cast<const volatile uint32_t *>(&field);
+}
+
+static const AppEntry *entryAt(const SharedMemoryHeader *header, uint32_t slot) {
+  uintptr_t offset = header->dwAppArrOffset + (uintptr_t)slot * header->dwAppEntrySize;
+  if (mappedSize != 0 && offset + sizeof(AppEntry) > mappedSize) {
+    return nullptr;
+  }
+  return reinterpret_cast<const AppEntry *>(reinterpret_cast<const char *>(header) + offset);
+}
+
+// Full scan of the app array for every instance of the game, in one pass.
+// Runs when a cached slot stopped being the game and once per watcher poll,
+// name matching goes through string_view so nothing is allocated.
+static void resolveInstances(const SharedMemoryHeader *header) {
+  std::string_view target = targetProcess;
+  instanceCount = 0;
+  for (uint32_t i = 0; i < header->dwAppArrSize && instanceCount < maxInstances; ++i) {
+    const AppEntry *entry = entryAt(header, i);
+    if (entry == nullptr) {
+      break;
+    }
+    uint32_t processId = readField(entry->dwProcessID);
+    if (processId == 0) {
+      continue;
+    }
+    const char *nameEnd = std::find(entry->szName, entry->szName + sizeof(entry->szName), '\0');
+    std::string_view applicationName(entry->szName, nameEnd - entry->szName);
+    if (applicationName.find(target) != std::string_view::npos) {
+      instances[instanceCount++] = {i, processId};
+    }
+  }
+  cachedEntrySize = header->dwAppEntrySize;
+  cachedArrOffset = header->dwAppArrOffset;
+  // Nothing found is not worth caching, the game may just not be hooked yet
+  instancesValid = instanceCount != 0;
+  resolves++;
+}
+
+// Picks up a game the watcher found, closed or started again under another
+// name, and asks for a rescan once per watcher poll. Two relaxed loads when
+// nothing changed.
+static void applyWatcher() {
+  uint32_t polls = watcherPolls.load(std::memory_order_relaxed);
+  if (polls == appliedPolls) {
+    return;
+  }
+  appliedPolls = polls;
+  instancesValid = false;
+  int target = watchedTarget.load(std::memory_order_relaxed);
+  if (target != appliedTarget) {
+    appliedTarget = target;
+    targetProcess = target >= 0 ? std::string(watchedNames[target]) : std::string();
+  }
+}
+
+// The header if the segment is usable, with instances up to date
+static const SharedMemoryHeader *prepareRead() {
+  applyWatcher();
+  const SharedMemoryHeader *header = getHeader();
+  if (header == nullptr || targetProcess.empty()) {
+    return nullptr;
+  }
+  if (readField(header->dwSignature) != sharedMemorySignature) {
+    // RTSS is (re)initializing the segment
+    instancesValid = false;
+    return nullptr;
+  }
+  // Cheap path, the array hasn't been laid out differently. Each slot is
+  // checked against its process ID when it's read.
+  if (!instancesValid || header->dwAppEntrySize != cachedEntrySize ||
+      header->dwAppArrOffset != cachedArrOffset) {
+    resolveInstances(header);
+  }
+  return header;
+}
+
+const AppEntry *getAppEntry() {
+  const SharedMemoryHeader *header = prepareRead();
+  if (header == nullptr || instanceCount == 0 ||
+      instances[0].slot >= readField(header->dwAppArrSize)) {
+    return nullptr;
+  }
+  const AppEntry *entry = entryAt(header, instances[0].slot);
+  if (entry == nullptr || readField(entry->dwProcessID) != instances[0].processId) {
+    instancesValid = false;
+    return nullptr;
+  }
+  return entry;
+}
+
+static void copyEntry(const AppEntry *entry, EntrySnapshot &snapshot) {
+  snapshot.processId = readField(entry->dwProcessID);
+  snapshot.time0 = readField(entry->dwTime0);
+  snapshot.time1 = readField(entry->dwTime1);
+  snapshot.frames = readField(entry->dwFrames);
+  snapshot.frameTime = readField(entry->dwFrameTime);
+  snapshot.statFramerateAvg = readField(entry->dwStatFramerateAvg);
+  snapshot.osdFrame = readField(entry->dwOSDFrame);
+}
+
+static bool sameSnapshot(const EntrySnapshot &a, const EntrySnapshot &b) {
+  return a.processId == b.processId && a.time0 == b.time0 &&
+         a.time1 == b.time1 && a.frames == b.frames &&
+         a.frameTime == b.frameTime && a.statFramerateAvg == b.statFramerateAvg &&
+         a.osdFrame == b.osdFrame;
+}
+
+bool startCapture(const char *path) { return capture.open(path); }
+
+void stopCapture() { capture.close(); }
+
+// RTSS has no sequence counter for app entries, it just writes the fields one
+// by one on every present. So we do the reader half of a seqlock with the
+// entry itself as the sequence: copy it, copy it again, and only trust it if
+// nothing moved in between. A present is a handful of stores, so when the
+// copies disagree a short spin lets the writer get through the rest of it
+// before we try again. It can't see a writer that got descheduled halfway
+// through a present, both copies agree on the half written entry then.
+static bool readInstance(const SharedMemoryHeader *header, const Instance &instance,
+                         EntrySnapshot &snapshot) {
+  if (instance.slot >= readField(header->dwAppArrSize)) {
+    instancesValid = false;
+    return false;
+  }
+  const AppEntry *entry = entryAt(header, instance.slot);
+  if (entry == nullptr) {
+    instancesValid = false;
+    return false;
+  }
+  for (int attempt = 0; attempt < maxSnapshotAttempts; attempt++) {
+    EntrySnapshot check;
+    copyEntry(entry, snapshot);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    copyEntry(entry, check);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // The segment could have been torn down or the slot handed to another
+    // process while we were copying
+    if (readField(header->dwSignature) != sharedMemorySignature ||
+        readField(header->dwVersion) < minimumVersion) {
+      return false;
+    }
+    if (sameSnapshot(snapshot, check)) {
+      if (snapshot.processId != instance.processId) {
+        instancesValid = false; // closed or restarted, rescan next time
+        return false;
+      }
+      return true;
+    }
+    snapshotRetries++;
+    for (int i = 0; i < retrySpins; i++) {
+      CPU_PAUSE();
+    }
+  }
+  tornReads++;
+  return false;
+}
+
+int readSnapshots(EntrySnapshot *snapshots, int capacity) {
+  const SharedMemoryHeader *header = prepareRead();
+  if (header == nullptr) {
+    return 0;
+  }
+  int count = 0;
+  for (int i = 0; i < instanceCount && count < capacity; i++) {
+    if (readInstance(header, instances[i], snapshots[count])) {
+      count++;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    capture.append(snapshots[i]); // nothing unless startCapture was called
+  }
+  return count;
+}
+
+bool readSnapshot(EntrySnapshot &snapshot) {
+  const SharedMemoryHeader *header = prepareRead();
+  if (header == nullptr || instanceCount == 0 || !readInstance(header, instances[0], snapshot)) {
+    return false;
+  }
+  capture.append(snapshot);
+  return true;
+}
+
+std::optional<double> getRawFrametime() {
+  EntrySnapshot snapshot;
+  if (!readSnapshot(snapshot)) {
+    return std::nullopt;
+  }
+  return snapshot.frametimeMs();
+}
+
+} // namespace RTSSReader
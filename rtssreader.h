@@ -0,0 +1,121 @@
+#ifndef RTSSREADER_H
+#define RTSSREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace Process {
+class Probe;
+}
+
+namespace RTSSReader {
+// Leading fields of RTSS_SHARED_MEMORY and RTSS_SHARED_MEMORY_APP_ENTRY from
+// RTSSSharedMemory.h. We only read these so the rest of the structs is left out,
+// the real entry size always comes from dwAppEntrySize.
+struct SharedMemoryHeader {
+  uint32_t dwSignature; // 'RTSS' once the segment is initialized
+  uint32_t dwVersion;
+  uint32_t dwAppEntrySize;
+  uint32_t dwAppArrOffset;
+  uint32_t dwAppArrSize;
+  uint32_t dwOSDEntrySize;
+  uint32_t dwOSDArrOffset;
+  uint32_t dwOSDArrSize;
+  uint32_t dwOSDFrame;
+};
+
+struct AppEntry {
+  uint32_t dwProcessID;
+  char szName[260];
+  uint32_t dwFlags;
+  uint32_t dwTime0;     // start of the current framerate period in ms
+  uint32_t dwTime1;     // time of the last presented frame in ms
+  uint32_t dwFrames;    // frames presented since dwTime0, reset every period
+  uint32_t dwFrameTime; // last frametime in microseconds
+  uint32_t dwStatFlags;
+  uint32_t dwStatTime0;
+  uint32_t dwStatTime1;
+  uint32_t dwStatFrames;
+  uint32_t dwStatCount;
+  uint32_t dwStatFramerateMin;
+  uint32_t dwStatFramerateAvg;
+  uint32_t dwStatFramerateMax;
+  uint32_t dwOSDX;
+  uint32_t dwOSDY;
+  uint32_t dwOSDPixel;
+  uint32_t dwOSDColor;
+  uint32_t dwOSDFrame; // used to be framesGeneratedMemoryOffset (332)
+};
+
+static_assert(offsetof(AppEntry, dwFrameTime) == 280);
+static_assert(offsetof(AppEntry, dwOSDFrame) == 332);
+
+constexpr uint32_t sharedMemorySignature = 0x52545353; // 'RTSS'
+constexpr uint32_t minimumVersion = 0x00020000; // the V2 layout above
+constexpr const char *sharedMemoryName = "RTSSSharedMemoryV2";
+
+// Everything useful from the game's entry, read in one go
+struct EntrySnapshot {
+  uint32_t processId;
+  uint32_t time0;
+  uint32_t time1;
+  uint32_t frames;
+  uint32_t frameTime; // microseconds
+  uint32_t statFramerateAvg;
+  uint32_t osdFrame;
+
+  double frametimeMs() const { return frameTime / 1000.0; }
+};
+
+// Executables we read the entry of, the first one running wins
+inline constexpr std::string_view knownTargets[] = {
+    "GTA5_Enhanced.exe", "GTA5.exe", "game_win64_final.exe"};
+
+// Running copies of the game that get read at once, more are ignored
+constexpr int maxInstances = 8;
+
+extern std::string targetProcess;
+extern uint64_t resolves;        // how often the app array had to be rescanned
+extern uint64_t snapshotRetries; // copies that changed under us and were redone
+extern uint64_t tornReads;       // snapshots given up on after every retry
+
+// Looks for the game and the RTSS shared memory once a second on a thread of
+// its own, so they can start in any order and the game can be restarted.
+// Each look is one walk over the process list for all of names, the first
+// one running becomes targetProcess on the next poll. onTarget runs on the
+// watcher thread with the game's name, or empty once it's closed.
+void startWatching(Process::Probe &probe, std::function<void(std::string_view)> onTarget,
+                   std::span<const std::string_view> names = knownTargets);
+void stopWatching();
+// Whether the shared memory is mapped yet
+bool attached();
+// Maps the RTSS shared memory read only. Returns false if it doesn't exist
+// yet, true right away if it's already mapped.
+bool openSharedMemory();
+const SharedMemoryHeader *getHeader();
+// Entry of the first instance of targetProcess in the app array, nullptr if
+// RTSS isn't tracking it. The slots of all instances are cached and
+// revalidated against their process IDs so a restarted game or a reshuffled
+// array gets picked up instead of read stale.
+const AppEntry *getAppEntry();
+// Consistent copies of every instance's entry, in app array order. Returns
+// how many were read, the ones that changed hands while we were reading or
+// RTSS kept writing through every retry are left out.
+int readSnapshots(EntrySnapshot *snapshots, int capacity);
+// Just the first instance, false if it couldn't be read even when later
+// ones could
+bool readSnapshot(EntrySnapshot &snapshot);
+std::optional<double> getRawFrametime();
+
+// From now on every snapshot that gets read is also appended to a capture
+// file (capture.h) if it changed since the last one of that instance
+bool startCapture(const char *path);
+void stopCapture();
+} // namespace RTSSReader
+
+#endif
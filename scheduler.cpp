@@ -0,0 +1,451 @@
+#include "scheduler.h"
+#include "macro.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+
+namespace InputHandler {
+ExecutionMode executionMode = ExecutionMode::Inline;
+TaskExecutor taskExecutor;
+TaskRing<Task, 1024> lanes[maxLanes];
+uint64_t keyConflicts = 0;
+bool (*isKeyHeld)(uint16_t vkCode) = nullptr;
+uint64_t repeatsCancelled = 0;
+
+// Bit per lane that might have tasks, so a frame only looks at those.
+// Producers set it after pushing, the consumer only clears it after seeing
+// the lane empty and checks again after.
+static std::atomic<uint32_t> activeLanes;
+OutputSink::Sink *outputSink = nullptr;
+Latency::Histogram inputLatency[3];
+Telemetry::Writer *telemetry = nullptr;
+Trace::Recorder traceRecorder;
+FrameGen::Detector frameGen;
+TimingMode timingMode = TimingMode::Detection;
+double predictedOffsetMs = 0.5;
+FramePredictor::Model framePredictor;
+FrameStats::Tracker frameStats;
+bool holdOnHitch = false;
+TimingStats timingStats;
+
+static FrameSource::Frame currentFrame;
+static bool frameLatencyRecorded;
+static OutputSink::Batch frameBatch;
+// Lane + 1 holding each key down, 0 for nobody
+static uint8_t keyOwner[256];
+
+// Counted in rendered frames since the predictor started
+static uint64_t renderedFrames;
+static uint64_t steppedFrame; // last one a step ran for
+static FrameSource::Frame lastRendered;
+static int lastMultiplier = 1;
+
+static_assert(Telemetry::maxLanes == maxLanes);
+static uint64_t framesMissed;
+// Only rewritten where it changed, a lane's macro name only when it starts
+// another one
+static Telemetry::StepBlock publishedSteps;
+static const Macro::Program *publishedPrograms[maxLanes];
+
+void queueTask(Task task, int lane) {
+  if (!lanes[lane].push(std::move(task))) {
+    fprintf(stderr, "Task queue for lane %d is full, dropping task\n", lane);
+    return;
+  }
+  activeLanes.fetch_or(1u << lane, std::memory_order_release);
+}
+
+bool tasksQueued() { return activeLanes.load(std::memory_order_acquire) != 0; }
+
+void queueTask(int delay, std::optional<std::function<void()>> function,
+               bool recursive) {
+  Task task = function.has_value()
+                  ? Task::call(std::move(function.value()), recursive)
+                  : Task::sleep(recursive);
+  task.delay = delay;
+  queueTask(std::move(task));
+}
+
+void queueInput(uint16_t vkCode, std::optional<bool> state, bool recursive) {
+  if (state.has_value()) {
+    queueTask(Task::key(vkCode, state.value(), recursive));
+  } else {
+    queueTask(Task::key(vkCode, true, false));
+    queueTask(Task::key(vkCode, false, recursive));
+  }
+}
+
+// Slow path for macros built at runtime, compiles and expands into separate
+// tasks every call. Keybinds compile their macro once when they are created.
+void queueInputs(std::vector<std::string> inputs,
+                 std::function<void()> callback) {
+  Macro::Program program;
+  std::vector<Macro::ParseError> errors;
+  if (!Macro::compile(inputs, program, errors, std::move(callback))) {
+    for (const Macro::ParseError &error : errors) {
+      fprintf(stderr, "queueInputs \"%s\": %s\n", error.input.c_str(),
+              error.message.c_str());
+    }
+    return;
+  }
+  for (const Macro::Instruction &instruction : program.instructions) {
+    switch (instruction.op) {
+    case Macro::Opcode::KeyDown:
+    case Macro::Opcode::KeyUp:
+      queueTask(Task::key(instruction.vkCode,
+                          instruction.op == Macro::Opcode::KeyDown,
+                          instruction.recursive));
+      break;
+    case Macro::Opcode::Wheel:
+      queueTask(Task::wheel(instruction.vkCode, instruction.recursive));
+      break;
+    case Macro::Opcode::Sleep:
+      queueTask(Task::sleep(instruction.recursive));
+      break;
+    case Macro::Opcode::Callback:
+      queueTask(Task::call(std::move(program.callback), instruction.recursive));
+      break;
+    }
+  }
+}
+
+// Inputs only get collected here, flushInputs sends them
+void sendKey(int lane, uint16_t vkCode, bool press) {
+  // Wheel codes are past 0xFF, those don't stay down
+  if (vkCode <= 0xFF) {
+    uint8_t &owner = keyOwner[vkCode];
+    if (owner != 0 && owner != lane + 1) {
+      keyConflicts++;
+      return;
+    }
+    owner = press ? lane + 1 : 0;
+  }
+  frameBatch.add(*outputSink, vkCode, press);
+}
+
+void flushInputs() {
+  if (frameBatch.empty()) {
+    return;
+  }
+  uint32_t count = frameBatch.size();
+  frameBatch.flush(*outputSink);
+  FrameSource::Clock::time_point now = FrameSource::Clock::now();
+  traceRecorder.record(Trace::EventType::InputSubmitted, currentFrame.index,
+                       count, now);
+  if (!frameLatencyRecorded) {
+    frameLatencyRecorded = true;
+    inputLatency[(int)executionMode].record(now - currentFrame.detectedAt);
+    publishedSteps.lastLatencyNs =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - currentFrame.detectedAt).count();
+  }
+}
+
+void runCallback(InlineCallback callback) {
+  if (executionMode == ExecutionMode::Inline) {
+    taskExecutor.enqueue(std::move(callback));
+  } else {
+    callback();
+  }
+}
+
+// Runs the next instruction of a Program task, returns whether the one after
+// it should run in the same frame
+bool stepProgram(int lane, Task &task) {
+  const Macro::Instruction &instruction = task.program->instructions[task.pc++];
+  switch (instruction.op) {
+  case Macro::Opcode::KeyDown:
+  case Macro::Opcode::KeyUp:
+    sendKey(lane, instruction.vkCode, instruction.op == Macro::Opcode::KeyDown);
+    break;
+  case Macro::Opcode::Wheel:
+    sendKey(lane, instruction.vkCode, true);
+    break;
+  case Macro::Opcode::Sleep:
+    break;
+  case Macro::Opcode::Callback:
+    flushInputs(); // whatever came before the callback goes out first
+    runCallback([program = task.program]() { program->callback(); });
+    break;
+  }
+  return instruction.recursive;
+}
+
+void executeTask(int lane, Task &task) {
+  switch (task.type) {
+  case TaskType::Sleep:
+    break;
+  case TaskType::KeyDown:
+  case TaskType::KeyUp:
+    sendKey(lane, task.vkCode, task.type == TaskType::KeyDown);
+    break;
+  case TaskType::Wheel:
+    sendKey(lane, task.vkCode, true);
+    break;
+  case TaskType::Callback:
+    flushInputs();
+    runCallback(std::move(task.callback));
+    break;
+  case TaskType::Program:
+    break;
+  }
+}
+
+// Lets go of everything lane pressed and didn't release yet
+static void releaseLaneKeys(int lane) {
+  for (int vkCode = 0; vkCode <= 0xFF; vkCode++) {
+    if (keyOwner[vkCode] == lane + 1) {
+      sendKey(lane, vkCode, false);
+    }
+  }
+}
+
+// One frame of a lane, its first task and the ones chained to it with R
+static void stepLane(int lane, const FrameSource::Frame &frame) {
+  TaskRing<Task, 1024> &tasks = lanes[lane];
+  Task *held = tasks.front();
+  if (held != nullptr && held->type == TaskType::Program &&
+      held->repeats == Task::repeatForever && isKeyHeld != nullptr &&
+      !isKeyHeld(held->vkCode)) {
+    tasks.pop();
+    releaseLaneKeys(lane);
+    repeatsCancelled++;
+    return;
+  }
+  while (true) {
+    Task *firstTask = tasks.front();
+    if (firstTask == nullptr || --firstTask->delay >= 0) {
+      break;
+    }
+
+    // Programs stay at the front of the queue until their last instruction
+    if (firstTask->type == TaskType::Program) {
+      bool recursive = false;
+      if (firstTask->pc < firstTask->program->instructions.size()) {
+        traceRecorder.record(
+            Trace::EventType::TaskDequeued, frame.index,
+            firstTask->program->instructions[firstTask->pc].vkCode);
+        recursive = stepProgram(lane, *firstTask);
+      }
+      if (firstTask->pc >= firstTask->program->instructions.size()) {
+        if (firstTask->repeats == 0) {
+          tasks.pop();
+        } else {
+          // Same task, back to the start. The next round always starts on
+          // a new frame, so a program that's all R can't spin forever.
+          firstTask->pc = 0;
+          if (firstTask->repeats != Task::repeatForever) {
+            firstTask->repeats--;
+          }
+          break;
+        }
+      }
+      if (!recursive) {
+        break;
+      }
+      continue;
+    }
+
+    Task task = std::move(*firstTask);
+    tasks.pop();
+
+    traceRecorder.record(Trace::EventType::TaskDequeued, frame.index,
+                         task.vkCode);
+    executeTask(lane, task);
+    if (!task.recursive) {
+      break;
+    }
+  }
+}
+
+// What every lane is up to now, from the thread that runs their steps
+static void publishSteps(const FrameSource::Frame &frame) {
+  publishedSteps.frameIndex = frame.index;
+  publishedSteps.frames++;
+  for (int lane = 0; lane < maxLanes; lane++) {
+    Telemetry::LaneState &state = publishedSteps.lanes[lane];
+    const Task *task = lanes[lane].front();
+    const Macro::Program *program =
+        task != nullptr && task->type == TaskType::Program ? task->program : nullptr;
+    if (program != publishedPrograms[lane]) {
+      publishedPrograms[lane] = program;
+      size_t length = program == nullptr ? 0 : std::min(program->name.size(), sizeof(state.macro) - 1);
+      std::fill(std::begin(state.macro), std::end(state.macro), '\0');
+      std::copy_n(program == nullptr ? "" : program->name.data(), length, state.macro);
+    }
+    state.step = program == nullptr ? 0 : task->pc;
+    state.steps = program == nullptr ? 0 : program->instructions.size();
+    state.queued = lanes[lane].size();
+    state.repeating = task == nullptr ? 0 : task->repeats;
+  }
+  telemetry->publish(publishedSteps);
+}
+
+static void publishFrame(const FrameSource::Frame &frame) {
+  Telemetry::FrameBlock block;
+  block.index = frame.index;
+  block.missed = framesMissed;
+  block.hitches = frameStats.hitches;
+  block.frametimeMs = frameStats.lastMs();
+  FrameStats::Summary pacing = frameStats.overall();
+  block.p50Ms = pacing.p50;
+  block.p99Ms = pacing.p99;
+  block.activeLanes = activeLanes.load(std::memory_order_relaxed);
+  block.queued = 0;
+  for (uint32_t active = block.activeLanes; active != 0; active &= active - 1) {
+    block.queued += lanes[std::countr_zero(active)].size();
+  }
+  block.updatedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        FrameSource::Clock::now().time_since_epoch())
+                        .count();
+  telemetry->publish(block);
+}
+
+void executeFirstQueuedTask(const FrameSource::Frame &frame) {
+  currentFrame = frame;
+  frameLatencyRecorded = false;
+  uint32_t active = activeLanes.load(std::memory_order_acquire);
+  bool publish = active != 0 && telemetry != nullptr;
+  while (active != 0) {
+    int lane = std::countr_zero(active);
+    uint32_t bit = 1u << lane;
+    active &= ~bit;
+    stepLane(lane, frame);
+    if (lanes[lane].empty()) {
+      activeLanes.fetch_and(~bit, std::memory_order_acq_rel);
+      // A push that raced with clearing it
+      if (!lanes[lane].empty()) {
+        activeLanes.fetch_or(bit, std::memory_order_release);
+      }
+    }
+  }
+  // One SendInput for everything this frame
+  flushInputs();
+  if (publish) {
+    publishSteps(frame);
+  }
+}
+
+static void runFrame(const FrameSource::Frame &frame) {
+  if (executionMode == ExecutionMode::Executor) {
+    taskExecutor.enqueue([frame]() { executeFirstQueuedTask(frame); });
+  } else {
+    executeFirstQueuedTask(frame);
+  }
+}
+
+void onFrame(const FrameSource::Frame &frame) {
+  traceRecorder.record(Trace::EventType::FrameDetected, frame.index,
+                       frame.advanced, frame.detectedAt);
+  frameStats.onFrame(frame);
+  framesMissed += frame.advanced > 1 ? frame.advanced - 1 : 0;
+  if (telemetry != nullptr) {
+    publishFrame(frame);
+  }
+  if (!frameGen.onFrame(frame)) {
+    return;
+  }
+
+  // The predictor works in rendered frames, with frame generation those are
+  // multiplier presents apart
+  int multiplier = frameGen.stats().multiplier;
+  if (multiplier != lastMultiplier) {
+    lastMultiplier = multiplier;
+    framePredictor.reset();
+  }
+  uint64_t periods = 1;
+  if (renderedFrames != 0 && frame.index > lastRendered.index) {
+    periods = (frame.index - lastRendered.index + multiplier / 2) / multiplier;
+    periods = periods == 0 ? 1 : periods;
+  }
+  framePredictor.onFrame(frame.detectedAt, periods);
+  renderedFrames += periods;
+  lastRendered = frame;
+  // Missed frames are missed, one step per frame like always
+  if (steppedFrame + 1 < renderedFrames) {
+    steppedFrame = renderedFrames - 1;
+  }
+  if (holdOnHitch && frameStats.holding()) {
+    if (tasksQueued()) {
+      timingStats.heldSteps++;
+    }
+    steppedFrame = renderedFrames;
+    return;
+  }
+
+  if (timingMode == TimingMode::Predicted && framePredictor.stable(predictedOffsetMs)) {
+    // Nothing queued yet, don't fire into the middle of this frame if
+    // something shows up later
+    if (!tasksQueued()) {
+      steppedFrame = renderedFrames;
+    }
+    onTick(frame.detectedAt);
+    return;
+  }
+  if (steppedFrame < renderedFrames) {
+    steppedFrame = renderedFrames;
+    if (tasksQueued()) {
+      timingStats.detectedSteps++;
+    }
+    runFrame(frame);
+  }
+}
+
+FrameSource::Clock::time_point onTick(FrameSource::Clock::time_point now) {
+  if (timingMode != TimingMode::Predicted || !framePredictor.stable(predictedOffsetMs) ||
+      !tasksQueued()) {
+    return FrameSource::Clock::time_point::max();
+  }
+  // Either the frame that was just detected, if we haven't got to its
+  // offset yet, or the one after it. Never further ahead than that, if it
+  // doesn't show up the next detection decides what happens.
+  uint64_t target = steppedFrame + 1;
+  if (target > renderedFrames + 1) {
+    return FrameSource::Clock::time_point::max();
+  }
+  uint64_t ahead = target - renderedFrames;
+  FrameSource::Clock::time_point boundary = framePredictor.boundary(ahead);
+  FrameSource::Clock::time_point deadline =
+      boundary + std::chrono::duration_cast<FrameSource::Clock::duration>(
+                     std::chrono::duration<double, std::milli>(predictedOffsetMs));
+  if (now < deadline) {
+    return deadline;
+  }
+
+  steppedFrame = target;
+  timingStats.predictedSteps++;
+  FrameSource::Frame frame = lastRendered;
+  frame.index += ahead * lastMultiplier;
+  frame.advanced = ahead == 0 ? frame.advanced : lastMultiplier;
+  frame.detectedAt = boundary; // latency counts from the predicted present
+  traceRecorder.record(Trace::EventType::FramePredicted, frame.index,
+                       frame.advanced, boundary);
+  runFrame(frame);
+  return FrameSource::Clock::time_point::max();
+}
+
+void resetQueue() {
+  for (TaskRing<Task, 1024> &lane : lanes) {
+    while (lane.front() != nullptr) {
+      lane.pop();
+    }
+  }
+  activeLanes.store(0, std::memory_order_release);
+  std::fill(std::begin(keyOwner), std::end(keyOwner), 0);
+  publishedSteps = {};
+  std::fill(std::begin(publishedPrograms), std::end(publishedPrograms), nullptr);
+}
+
+void resetTiming() {
+  framePredictor.reset();
+  frameStats.reset();
+  framesMissed = 0;
+  timingStats = {};
+  renderedFrames = 0;
+  steppedFrame = 0;
+  lastRendered = {};
+  lastMultiplier = 1;
+}
+} // namespace InputHandler
@@ -0,0 +1,118 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "framegen.h"
+#include "framepredictor.h"
+#include "framestats.h"
+#include "framesource.h"
+#include "latency.h"
+#include "outputsink.h"
+#include "task.h"
+#include "taskexecutor.h"
+#include "taskring.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The frame-synchronized task queue and what runs it. Nothing in here is
+// Windows specific, inputs go to whatever outputSink points at, so the
+// simulator can drive the same code main.cpp does.
+namespace InputHandler {
+// Inline runs frame tasks right on the frame thread. Executor is the old
+// way, every frame hops over to the executor thread first. Synchronous runs
+// callbacks in place too, for the simulator where there are no threads.
+enum class ExecutionMode { Inline, Executor, Synchronous };
+extern ExecutionMode executionMode;
+
+// Callbacks can take as long as they want, in inline mode they go to the
+// executor so they never hold up the frame thread
+extern TaskExecutor taskExecutor;
+
+// Each lane runs its own macro at its own pace, a step per frame, no matter
+// what the others are doing. Whatever all of them send in a frame goes out
+// in one batch, lower lanes first. A key one lane pressed belongs to it until
+// it lets go, presses and releases of it from other lanes in the meantime
+// are dropped and counted in keyConflicts.
+//
+// Pushed to from the keyboard hook and from callbacks on the executor, only
+// ever drained by executeFirstQueuedTask
+constexpr int maxLanes = 8;
+extern TaskRing<Task, 1024> lanes[maxLanes];
+extern uint64_t keyConflicts;
+
+// Whether a key is physically held, for programs queued with runWhileHeld.
+// Asked once per frame at most, before the lane's step. Once it says no the
+// program is dropped and whatever keys the lane still holds are released in
+// that same frame.
+extern bool (*isKeyHeld)(uint16_t vkCode);
+extern uint64_t repeatsCancelled;
+
+extern OutputSink::Sink *outputSink;
+
+// Frame detected to inputs submitted, one histogram per mode
+extern Latency::Histogram inputLatency[3];
+
+// Live frame and lane state for overlays and the monitor tool. The frame
+// block goes out from onFrame, the step block after every frame that ran
+// steps. Nothing is published while it's null.
+extern Telemetry::Writer *telemetry;
+
+// Drained and written out by the exporter in main
+extern Trace::Recorder traceRecorder;
+
+// For DLSS Frame Generation, RTSS counts generated frames too so tasks only
+// run on the ones frameGen thinks were rendered. setForced on it pins the
+// multiplier instead of detecting it.
+extern FrameGen::Detector frameGen;
+
+// Detection runs a step as soon as a frame is noticed. Predicted runs it
+// predictedOffsetMs into the frame framePredictor expects next. If frames
+// land further off the prediction than that, a step could end up in the
+// frame before, so it falls back to detection until they settle.
+enum class TimingMode { Detection, Predicted };
+extern TimingMode timingMode;
+extern double predictedOffsetMs;
+extern FramePredictor::Model framePredictor;
+
+// Pacing of every present, fed before frame generation filtering. With
+// holdOnHitch set no step runs on a frame frameStats calls a hitch or the
+// couple after it, the game is likely to eat or merge inputs then. The
+// steps just move to the next frames, like they do for missed ones.
+extern FrameStats::Tracker frameStats;
+extern bool holdOnHitch;
+
+struct TimingStats {
+  uint64_t predictedSteps = 0; // steps run at a predicted time
+  uint64_t detectedSteps = 0;  // steps run on detection, all of them in detection mode
+  uint64_t heldSteps = 0;      // frames a step waited out because of a hitch
+};
+extern TimingStats timingStats;
+
+// Callbacks and queueInputs always go to lane 0
+void queueTask(Task task, int lane = 0);
+bool tasksQueued(); // on any lane
+void queueTask(int delay, std::optional<std::function<void()>> function,
+               bool recursive);
+void queueInput(uint16_t vkCode, std::optional<bool> state, bool recursive);
+void queueInputs(std::vector<std::string> inputs,
+                 std::function<void()> callback = nullptr);
+
+// Called for every frame the engine sees, runs or hands off the frame's
+// tasks depending on executionMode
+void onFrame(const FrameSource::Frame &frame);
+// Called between polls, runs a predicted step if it's due. Returns when it
+// wants to be called again, time_point::max() if nothing is scheduled.
+FrameSource::Clock::time_point onTick(FrameSource::Clock::time_point now);
+void executeFirstQueuedTask(const FrameSource::Frame &frame);
+
+// Drops queued tasks on every lane, for the simulator
+void resetQueue();
+// Forgets the frame timing, pacing and the step counts, for the simulator
+void resetTiming();
+} // namespace InputHandler
+
+#endif
@@ -0,0 +1,415 @@
+// Runs the macros from keybinds.h through the scheduler on a simulated frame
+// clock and prints the frame every key event lands on.
+//
+//   simulate [clock] [macro...] timeline of one macro (by name) or all of them.
+//                               Several names run together on their own lanes.
+//   simulate bench [frames]     scheduler throughput on a fixed 240 fps clock,
+//                               once through and held down
+//   simulate accuracy [clock]   where in the frame inputs land with detection
+//                               and predicted timing, at a few poll latencies
+//                               and offsets
+//   simulate check <file>       parses a macro file like a reload would and
+//                               says what's wrong with it and how long it took
+//   simulate test               runs the keybinds.h macros against the frames
+//                               their inputs have to land on, exits 1 if any
+//                               moved
+//
+// clock is one of
+//   fixed <fps>                 (the default, 144)
+//   jitter <fps> <ms> <seed>
+//   framegen <fps> <multiplier> <skew>
+//                               base fps, multiplier presents per rendered
+//                               frame, skew 0 for even pacing. The scheduler
+//                               has to detect the multiplier itself.
+//   hitch <fps> <every> <ms>    fixed, except every nth frame takes ms
+//   trace <file.csv>            frame times from a --trace CSV
+//
+// --hitch-hold in front of the clock holds steps back on hitches like
+// main's --hitch-hold does
+#include "keybinds.h"
+#include "keymap.h"
+#include "macrofile.h"
+#include "scheduler.h"
+#include "simulator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Simulate {
+std::string keyName(uint16_t vkCode) {
+  if (vkCode == 0x1000 || vkCode == 0x1001) {
+    return vkCode == 0x1001 ? "wheelup" : "wheeldown";
+  }
+  // Shortest alias, "up" rather than "numpadup"
+  std::string_view best;
+  for (const key_to_vk_type &key : g_key_to_vk) {
+    if (key.vkCode == vkCode && (best.empty() || key.keyName.size() < best.size())) {
+      best = key.keyName;
+    }
+  }
+  if (!best.empty()) {
+    return std::string(best);
+  }
+  if ((vkCode >= 'A' && vkCode <= 'Z') || (vkCode >= '0' && vkCode <= '9')) {
+    return std::string(1, (char)vkCode);
+  }
+  return std::to_string(vkCode);
+}
+
+// Several macros run together, each on its own lane
+void printTimeline(const std::vector<const Keybinds::MacroKeybind *> &macros,
+                   Simulator::FrameClock &clock) {
+  std::vector<Simulator::Queued> programs;
+  std::string names;
+  for (const Keybinds::MacroKeybind *macro : macros) {
+    const Macro::Program *program = Macro::compileOrReport(macro->name, macro->inputs);
+    if (program == nullptr) {
+      return;
+    }
+    programs.push_back({program, macro->times});
+    names += names.empty() ? macro->name : std::string(" + ") + macro->name;
+  }
+  // Enough frames first for the frame generation detector to settle
+  Simulator::Options options;
+  options.warmupFrames = FrameGen::Detector::window * 2;
+  std::vector<Simulator::KeyEvent> events = Simulator::run(programs, clock, options);
+  printf("%s: %zu inputs over %llu frames\n", names.c_str(), events.size(),
+         events.empty() ? 0ull : (unsigned long long)events.back().frame);
+  for (const Simulator::KeyEvent &event : events) {
+    printf("  frame %4llu %9.3fms  %s %s\n", (unsigned long long)event.frame, event.timeMs,
+           keyName(event.vkCode).c_str(), event.press ? "down" : "up");
+  }
+  if (InputHandler::repeatsCancelled != 0) {
+    printf("  let go after %llu frames, stopped repeating\n",
+           (unsigned long long)options.holdFrames);
+  }
+  if (InputHandler::keyConflicts != 0) {
+    printf("  %llu inputs dropped, the key was held by another lane\n",
+           (unsigned long long)InputHandler::keyConflicts);
+  }
+  const FrameGen::Stats &stats = InputHandler::frameGen.stats();
+  FrameStats::Summary pacing = InputHandler::frameStats.overall();
+  printf("  frametimes: p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms, %llu hitches, held steps on %llu frames\n",
+         pacing.p50, pacing.p95, pacing.p99, InputHandler::frameStats.maxMs(),
+         (unsigned long long)InputHandler::frameStats.hitches,
+         (unsigned long long)InputHandler::timingStats.heldSteps);
+  printf("  frame generation: x%d, rendered phase %d, %s, confidence %.2f, cadence x2 %.2f x3 %.2f x4 %.2f\n",
+         stats.multiplier, stats.realPhase, FrameGen::sourceName(stats.source), stats.confidence,
+         stats.cadenceScore[2], stats.cadenceScore[3], stats.cadenceScore[4]);
+}
+
+int check(const char *path) {
+  std::vector<MacroFile::Entry> entries;
+  std::vector<MacroFile::Error> errors;
+  auto start = std::chrono::steady_clock::now();
+  bool loaded = MacroFile::load(path, nullptr, entries, errors);
+  double firstMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  for (const MacroFile::Error &error : errors) {
+    fprintf(stderr, "%s:%zu: %s\n", path, error.line, error.message.c_str());
+  }
+  if (!loaded) {
+    return 1;
+  }
+  for (const MacroFile::Entry &entry : entries) {
+    printf("%-12s lane %d, %s, %zu instructions\n", entry.key.c_str(), entry.lane,
+           entry.times == Keybinds::whileHeld ? "while held" : (std::to_string(entry.times) + "x").c_str(),
+           entry.program->instructions.size());
+  }
+  // Again with the first as the previous file, what saving it unchanged costs
+  std::vector<MacroFile::Entry> reloaded;
+  start = std::chrono::steady_clock::now();
+  MacroFile::load(path, &entries, reloaded, errors);
+  double reloadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("%zu macros, loaded in %.3fms, reloaded in %.3fms\n", entries.size(), firstMs, reloadMs);
+  return 0;
+}
+
+const Macro::Program *compileMacro(const char *name) {
+  for (const Keybinds::MacroKeybind &macro : Keybinds::macros) {
+    if (strcmp(macro.name, name) == 0) {
+      return Macro::compileOrReport(macro.name, macro.inputs);
+    }
+  }
+  return nullptr;
+}
+
+// "frame key down/up" for every event, what the tests compare
+std::string describe(const std::vector<Simulator::KeyEvent> &events) {
+  std::string text;
+  for (const Simulator::KeyEvent &event : events) {
+    text += text.empty() ? "" : ", ";
+    text += std::to_string(event.frame) + " " + keyName(event.vkCode) + (event.press ? " down" : " up");
+  }
+  return text;
+}
+
+int test() {
+  int failed = 0, passed = 0;
+  auto expect = [&](const char *what, bool ok, const std::string &detail = "") {
+    if (ok) {
+      passed++;
+      printf("ok    %s\n", what);
+    } else {
+      failed++;
+      printf("FAIL  %s\n%s", what, detail.c_str());
+    }
+  };
+  auto expectTimeline = [&](const char *what, const std::vector<Simulator::KeyEvent> &events,
+                            const char *expected) {
+    std::string actual = describe(events);
+    expect(what, actual == expected,
+           "  expected " + std::string(expected) + "\n  got      " + actual + "\n");
+  };
+  const Macro::Program *menu = compileMacro("220");
+  const Macro::Program *withSleep = compileMacro("shift+221");
+  const Macro::Program *chat = compileMacro("F6");
+  if (menu == nullptr || withSleep == nullptr || chat == nullptr) {
+    return 1;
+  }
+  Simulator::FixedClock clock(144);
+
+  // R runs the next step in the same frame, everything else waits for the next
+  expectTimeline("R chains steps into one frame", Simulator::run(*menu, clock),
+                 "1 M down, 2 M up, 2 enter down, 3 enter up, 4 enter down, 4 down down, "
+                 "5 down up, 6 down down, 7 down up, 8 down down, 9 down up, 10 down down, "
+                 "11 down up, 12 enter up, 13 enter down, 13 down down, 14 enter up, 15 down up");
+  clock.restart();
+  expectTimeline("sleep 2 after R skips two frames", Simulator::run(*withSleep, clock),
+                 "1 M down, 2 M up, 2 enter down, 3 up down, 4 up up, 5 up down, 6 up up, "
+                 "7 up down, 8 up up, 9 up down, 10 up up, 11 up down, 12 up up, 13 up down, "
+                 "14 up up, 15 enter up, 16 down down, 16 enter down, 17 down up, 18 enter up, "
+                 "20 space down, 20 M down, 21 M up, 21 space up");
+
+  // Let go halfway through the first round: nothing more of it runs and
+  // enter, still down from the first step, comes back up
+  Simulator::Options options;
+  options.holdFrames = 5;
+  clock.restart();
+  Simulator::Queued held[] = {{chat, Keybinds::whileHeld}};
+  expectTimeline("whileHeld stops and lets go when the key is", Simulator::run(held, clock, options),
+                 "1 enter down, 1 T down, 2 T up, 3 H down, 4 H up, 4 E down, 5 E up, 5 L down, "
+                 "6 enter up, 6 L up");
+  expect("whileHeld counts as cancelled", InputHandler::repeatsCancelled == 1);
+  options.holdFrames = 20;
+  clock.restart();
+  std::vector<Simulator::KeyEvent> rounds = Simulator::run(held, clock, options);
+  // A round is 14 inputs ending on frame 9, the next one starts on frame 10
+  expect("whileHeld starts over on a new frame while held",
+         rounds.size() > 14 && rounds[13].frame == 9 && rounds[14].frame == 10 &&
+             rounds[14].vkCode == rounds[0].vkCode && rounds[14].press,
+         "  got " + describe(rounds) + "\n");
+
+  // Generated frames in between mustn't get steps, so with x3 every input is
+  // three presents later than without and always on a rendered one
+  Simulator::Options settled;
+  settled.warmupFrames = FrameGen::Detector::window * 2;
+  clock.restart();
+  std::vector<Simulator::KeyEvent> plain = Simulator::run(*menu, clock, settled);
+  Simulator::FixedClock base(60);
+  Simulator::FrameGenClock generated(base, 3, 0.3);
+  std::vector<Simulator::KeyEvent> tripled = Simulator::run(*menu, generated, settled);
+  const FrameGen::Stats &stats = InputHandler::frameGen.stats();
+  expect("frame generation x3 is detected", stats.multiplier == 3,
+         "  detected x" + std::to_string(stats.multiplier) + "\n");
+  bool onRendered = tripled.size() == plain.size();
+  for (size_t i = 0; onRendered && i < plain.size(); i++) {
+    onRendered = tripled[i].frame == plain[i].frame * 3 && tripled[i].vkCode == plain[i].vkCode &&
+                 tripled[i].press == plain[i].press;
+  }
+  expect("frame generation steps only on rendered frames", onRendered,
+         "  without " + describe(plain) + "\n  x3      " + describe(tripled) + "\n");
+
+  printf("%d passed, %d failed\n", passed, failed);
+  return failed == 0 ? 0 : 1;
+}
+
+int bench(uint64_t frames) {
+  std::vector<const Macro::Program *> programs;
+  for (const Keybinds::MacroKeybind &macro : Keybinds::macros) {
+    programs.push_back(Macro::compileOrReport(macro.name, macro.inputs));
+  }
+  Simulator::FixedClock clock(240);
+  uint64_t framesRun = 0, inputs = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (framesRun < frames) {
+    for (const Macro::Program *program : programs) {
+      std::vector<Simulator::KeyEvent> events = Simulator::run(*program, clock);
+      framesRun += events.empty() ? 0 : events.back().frame;
+      inputs += events.size();
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("%llu frames, %llu inputs, %.1f ns/frame, %.1f ns/input\n",
+         (unsigned long long)framesRun, (unsigned long long)inputs, ns / framesRun, ns / inputs);
+
+  // Steady state of a held macro, the same task starting over every round
+  Simulator::Options options;
+  options.holdFrames = frames / programs.size();
+  options.maxFrames = options.holdFrames + 1;
+  framesRun = 0, inputs = 0;
+  start = std::chrono::steady_clock::now();
+  for (const Macro::Program *program : programs) {
+    Simulator::Queued queued[] = {{program, Keybinds::whileHeld}};
+    std::vector<Simulator::KeyEvent> events = Simulator::run(queued, clock, options);
+    framesRun += events.empty() ? 0 : events.back().frame;
+    inputs += events.size();
+  }
+  ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("held: %llu frames, %llu inputs, %.2f inputs/frame, %.1f ns/frame, %.1f ns/input\n",
+         (unsigned long long)framesRun, (unsigned long long)inputs, double(inputs) / framesRun,
+         ns / framesRun, ns / inputs);
+  return 0;
+}
+// Every macro a bunch of times per poll latency, once with steps on
+// detection and once at predicted times. A zero latency detection run of
+// the same frames is what it should look like, anything landing elsewhere
+// is wrong.
+int accuracy(Simulator::FrameClock &clock) {
+  std::vector<const Macro::Program *> programs;
+  for (const Keybinds::MacroKeybind &macro : Keybinds::macros) {
+    programs.push_back(Macro::compileOrReport(macro.name, macro.inputs));
+  }
+  constexpr int runs = 50;
+  Simulator::Options options;
+
+  double previousOffset = InputHandler::predictedOffsetMs;
+  for (double pollLatency : {0.25, 1.0, 2.0}) {
+    printf("poll latency up to %.2fms\n", pollLatency);
+    // Detection first, then predicted at a few offsets
+    for (double offset : {-1.0, 0.5, 1.5, 3.0}) {
+      InputHandler::TimingMode mode = offset < 0 ? InputHandler::TimingMode::Detection
+                                                 : InputHandler::TimingMode::Predicted;
+      InputHandler::predictedOffsetMs = offset;
+      uint64_t inputs = 0, wrongFrame = 0, predictedSteps = 0, steps = 0;
+      double sum = 0, squares = 0, worst = 0;
+      for (int run = 0; run < runs; run++) {
+        for (size_t i = 0; i < programs.size(); i++) {
+          options.warmupFrames = FrameGen::Detector::window * 2 + run; // different phase every run
+          options.pollLatencyMs = 0;
+          InputHandler::timingMode = InputHandler::TimingMode::Detection;
+          clock.restart();
+          std::vector<Simulator::KeyEvent> expected = Simulator::run(*programs[i], clock, options);
+
+          options.pollLatencyMs = pollLatency;
+          options.seed = run * 97 + i + 1;
+          InputHandler::timingMode = mode;
+          clock.restart();
+          std::vector<Simulator::KeyEvent> events = Simulator::run(*programs[i], clock, options);
+          predictedSteps += InputHandler::timingStats.predictedSteps;
+          steps += InputHandler::timingStats.predictedSteps + InputHandler::timingStats.detectedSteps;
+          for (size_t e = 0; e < events.size(); e++) {
+            wrongFrame += e >= expected.size() || events[e].frame != expected[e].frame;
+            sum += events[e].offsetMs;
+            squares += events[e].offsetMs * events[e].offsetMs;
+            worst = std::max(worst, events[e].offsetMs);
+          }
+          inputs += events.size();
+        }
+      }
+      double mean = inputs ? sum / inputs : 0;
+      double deviation = inputs ? std::sqrt(std::max(0.0, squares / inputs - mean * mean)) : 0;
+      char name[32];
+      if (offset < 0) {
+        snprintf(name, sizeof(name), "detection");
+      } else {
+        snprintf(name, sizeof(name), "+%.1fms", offset);
+      }
+      printf("  %-9s %6llu inputs, offset mean %.3fms sd %.3fms max %.3fms, %llu in the wrong frame, %.0f%% predicted\n",
+             name, (unsigned long long)inputs, mean, deviation, worst, (unsigned long long)wrongFrame,
+             steps ? 100.0 * predictedSteps / steps : 0.0);
+    }
+  }
+  InputHandler::timingMode = InputHandler::TimingMode::Detection;
+  InputHandler::predictedOffsetMs = previousOffset;
+  return 0;
+}
+} // namespace Simulate
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+    return Simulate::bench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000);
+  }
+  if (argc >= 3 && strcmp(argv[1], "check") == 0) {
+    return Simulate::check(argv[2]);
+  }
+  if (argc >= 2 && strcmp(argv[1], "test") == 0) {
+    return Simulate::test();
+  }
+
+  bool accuracy = argc >= 2 && strcmp(argv[1], "accuracy") == 0;
+  int next = accuracy ? 2 : 1;
+  if (next < argc && strcmp(argv[next], "--hitch-hold") == 0) {
+    InputHandler::holdOnHitch = true;
+    next++;
+  }
+
+  std::unique_ptr<Simulator::FrameClock> base;
+  std::unique_ptr<Simulator::FrameClock> clock;
+  // Clock arguments start at args[0]
+  char **args = argv + next;
+  int count = argc - next;
+  if (count >= 2 && strcmp(args[0], "fixed") == 0) {
+    clock = std::make_unique<Simulator::FixedClock>(atof(args[1]));
+    next += 2;
+  } else if (count >= 4 && strcmp(args[0], "jitter") == 0) {
+    clock = std::make_unique<Simulator::JitteredClock>(atof(args[1]), atof(args[2]),
+                                                       strtoul(args[3], nullptr, 10));
+    next += 4;
+  } else if (count >= 4 && strcmp(args[0], "framegen") == 0) {
+    int multiplier = atoi(args[2]);
+    if (multiplier < 1) {
+      fprintf(stderr, "multiplier has to be at least 1\n");
+      return 1;
+    }
+    base = std::make_unique<Simulator::FixedClock>(atof(args[1]));
+    clock = std::make_unique<Simulator::FrameGenClock>(*base, multiplier, atof(args[3]));
+    next += 4;
+  } else if (count >= 4 && strcmp(args[0], "hitch") == 0) {
+    clock = std::make_unique<Simulator::HitchClock>(atof(args[1]), strtoul(args[2], nullptr, 10),
+                                                    atof(args[3]));
+    next += 4;
+  } else if (count >= 2 && strcmp(args[0], "trace") == 0) {
+    std::vector<double> intervals;
+    if (!Simulator::loadTrace(args[1], intervals)) {
+      fprintf(stderr, "no frames in %s\n", args[1]);
+      return 1;
+    }
+    clock = std::make_unique<Simulator::RecordedClock>(std::move(intervals));
+    next += 2;
+  } else {
+    clock = std::make_unique<Simulator::FixedClock>(144);
+  }
+
+  if (accuracy) {
+    return Simulate::accuracy(*clock);
+  }
+
+  if (next >= argc) {
+    for (const Keybinds::MacroKeybind &macro : Keybinds::macros) {
+      Simulate::printTimeline({&macro}, *clock);
+    }
+    return 0;
+  }
+  std::vector<const Keybinds::MacroKeybind *> together;
+  for (int i = next; i < argc; i++) {
+    const Keybinds::MacroKeybind *found = nullptr;
+    for (const Keybinds::MacroKeybind &macro : Keybinds::macros) {
+      if (strcmp(argv[i], macro.name) == 0) {
+        found = &macro;
+      }
+    }
+    if (found == nullptr) {
+      fprintf(stderr, "no macro called %s\n", argv[i]);
+      return 1;
+    }
+    together.push_back(found);
+  }
+  Simulate::printTimeline(together, *clock);
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "simulator.h"
+#include "keybinds.h"
+#include "scheduler.h"
+#include <cstdio>
+#include <cstring>
+
+namespace Simulator {
+
+double JitteredClock::nextInterval() {
+  // xorshift32, same sequence on every platform
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  double offset = (state / 4294967295.0 * 2 - 1) * jitter;
+  return interval + offset > 0.1 ? interval + offset : 0.1;
+}
+
+double FrameGenClock::nextInterval() {
+  // Counts down, the rendered frame is the last one of each group
+  if (generated == 0) {
+    interval = base.nextInterval() / multiplier;
+    generated = multiplier;
+  }
+  generated--;
+  if (generated == 0) {
+    return interval * (1 + skew * (multiplier - 1));
+  }
+  return interval * (1 - skew);
+}
+
+double RecordedClock::nextInterval() {
+  if (intervals.empty()) {
+    return 1000.0 / 60;
+  }
+  double interval = intervals[next];
+  next = (next + 1) % intervals.size();
+  return interval;
+}
+
+bool loadTrace(const char *path, std::vector<double> &intervals) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char line[256];
+  long long lastNs = -1;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long long frame;
+    long long ns;
+    unsigned detail;
+    if (strncmp(line, "frame,", 6) != 0 ||
+        sscanf(line + 6, "%llu,%lld,%u", &frame, &ns, &detail) != 3) {
+      continue;
+    }
+    // A frame event that advanced by more than one covers several frames
+    if (lastNs >= 0 && detail != 0) {
+      for (unsigned i = 0; i < detail; i++) {
+        intervals.push_back((ns - lastNs) / 1e6 / detail);
+      }
+    }
+    lastNs = ns;
+  }
+  fclose(file);
+  return !intervals.empty();
+}
+
+std::vector<KeyEvent> run(std::span<const Queued> programs, FrameClock &clock,
+                          const Options &options) {
+  OutputSink::RecordingSink sink;
+  OutputSink::Sink *previousSink = InputHandler::outputSink;
+  InputHandler::ExecutionMode previousMode = InputHandler::executionMode;
+  InputHandler::outputSink = &sink;
+  InputHandler::executionMode = InputHandler::ExecutionMode::Synchronous;
+  InputHandler::resetQueue();
+  InputHandler::resetTiming();
+  InputHandler::keyConflicts = 0;
+  InputHandler::repeatsCancelled = 0;
+  InputHandler::frameGen.reset();
+  InputHandler::frameGen.setForced(options.forcedMultiplier);
+
+  // Frames carry simulated time, frame generation detection and prediction
+  // go by it
+  FrameSource::Clock::time_point start = FrameSource::Clock::now();
+  auto at = [&](double ms) {
+    return start + std::chrono::duration_cast<FrameSource::Clock::duration>(
+                       std::chrono::duration<double, std::milli>(ms));
+  };
+  uint32_t state = options.seed ? options.seed : 1;
+  auto pollLatency = [&]() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state / 4294967295.0 * options.pollLatencyMs;
+  };
+
+  uint64_t index = 0;      // presented so far
+  double presentMs = 0;    // when the latest one was
+  double detectedMs = 0;   // when the latest one was noticed
+  uint64_t queuedAt = 0;
+  double queuedAtMs = 0;
+  std::vector<KeyEvent> events;
+  auto collect = [&](size_t before, double nowMs) {
+    for (size_t i = before; i < sink.recorded.size(); i++) {
+      const OutputSink::Event &event = sink.recorded[i].event;
+      events.push_back({index - queuedAt, nowMs - queuedAtMs, nowMs - presentMs,
+                        event.vkCode, event.press});
+    }
+  };
+
+  // One present. Predicted steps due before it's noticed run first, those
+  // can land before or after the present itself.
+  auto present = [&]() {
+    double interval = clock.nextInterval();
+    double nextPresentMs = presentMs + interval;
+    double nextDetectedMs = nextPresentMs + pollLatency();
+    double nowMs = detectedMs;
+    FrameSource::Clock::time_point now = at(nowMs);
+    while (true) {
+      if (nowMs >= nextPresentMs && presentMs < nextPresentMs) {
+        index++;
+        presentMs = nextPresentMs;
+      }
+      size_t before = sink.recorded.size();
+      FrameSource::Clock::time_point deadline = InputHandler::onTick(now);
+      collect(before, nowMs);
+      if (deadline == FrameSource::Clock::time_point::max()) {
+        break;
+      }
+      double deadlineMs = std::chrono::duration<double, std::milli>(deadline - start).count();
+      if (deadlineMs >= nextDetectedMs) {
+        break;
+      }
+      now = deadline;
+      nowMs = deadlineMs;
+    }
+    if (presentMs < nextPresentMs) {
+      index++;
+      presentMs = nextPresentMs;
+    }
+    detectedMs = nextDetectedMs;
+    size_t before = sink.recorded.size();
+    InputHandler::onFrame({index, 1, interval, at(detectedMs)});
+    collect(before, detectedMs);
+  };
+  for (uint64_t i = 0; i < options.warmupFrames; i++) {
+    present();
+  }
+
+  // The held key is whatever isKeyHeld gets asked about, there's only one
+  static bool held;
+  held = true;
+  InputHandler::isKeyHeld = [](uint16_t) { return held; };
+  for (size_t lane = 0; lane < programs.size() && lane < InputHandler::maxLanes; lane++) {
+    const Queued &queued = programs[lane];
+    InputHandler::queueTask(queued.times == Keybinds::whileHeld
+                                ? InputHandler::Task::runWhileHeld(queued.program, 0)
+                                : InputHandler::Task::run(queued.program, queued.times),
+                            lane);
+  }
+  queuedAt = index;
+  queuedAtMs = detectedMs;
+
+  while (index - queuedAt < options.maxFrames && InputHandler::tasksQueued()) {
+    held = index - queuedAt < options.holdFrames;
+    present();
+  }
+
+  InputHandler::resetQueue();
+  InputHandler::isKeyHeld = nullptr;
+  InputHandler::outputSink = previousSink;
+  InputHandler::executionMode = previousMode;
+  return events;
+}
+} // namespace Simulator
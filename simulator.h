@@ -0,0 +1,135 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "macro.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Runs the real scheduler (scheduler.cpp) against a made up frame clock and a
+// recording sink, so macro timing can be checked and benchmarked without GTA,
+// RTSS or Windows. Everything is deterministic for a given clock and seed.
+namespace Simulator {
+// Time between presented frames in ms, one call per frame
+class FrameClock {
+public:
+  virtual ~FrameClock() = default;
+  virtual double nextInterval() = 0;
+  // Back to the first interval
+  virtual void restart() {}
+};
+
+class FixedClock : public FrameClock {
+public:
+  FixedClock(double fps) : interval(1000.0 / fps) {}
+  double nextInterval() override { return interval; }
+
+private:
+  double interval;
+};
+
+// Uniformly off by up to jitterMs either way
+class JitteredClock : public FrameClock {
+public:
+  JitteredClock(double fps, double jitterMs, uint32_t seed = 1)
+      : interval(1000.0 / fps), jitter(jitterMs), seed(seed ? seed : 1), state(this->seed) {}
+  double nextInterval() override;
+  void restart() override { state = seed; }
+
+private:
+  double interval;
+  double jitter;
+  uint32_t seed;
+  uint32_t state;
+};
+
+// Frame generation: every frame of base is followed by multiplier - 1
+// generated ones. RTSS counts all of them. With skew 0 they're evenly
+// spaced, with skew s the generated ones come s of an even slot early and
+// the rendered one makes up for it, which is what uneven FG pacing looks
+// like from the outside.
+class FrameGenClock : public FrameClock {
+public:
+  FrameGenClock(FrameClock &base, int multiplier, double skew = 0)
+      : base(base), multiplier(multiplier), skew(skew) {}
+  double nextInterval() override;
+  void restart() override {
+    base.restart();
+    generated = 0;
+  }
+
+private:
+  FrameClock &base;
+  int multiplier;
+  double skew;
+  int generated = 0;
+  double interval = 0;
+};
+
+// Steady frames with a stall of hitchMs every every frames
+class HitchClock : public FrameClock {
+public:
+  HitchClock(double fps, uint32_t every, double hitchMs)
+      : interval(1000.0 / fps), every(every ? every : 1), hitch(hitchMs) {}
+  double nextInterval() override { return ++frame % every == 0 ? hitch : interval; }
+  void restart() override { frame = 0; }
+
+private:
+  double interval;
+  uint32_t every;
+  double hitch;
+  uint32_t frame = 0;
+};
+
+// Replays recorded frame intervals, from the start again when they run out
+class RecordedClock : public FrameClock {
+public:
+  RecordedClock(std::vector<double> intervals) : intervals(std::move(intervals)) {}
+  double nextInterval() override;
+  void restart() override { next = 0; }
+
+private:
+  std::vector<double> intervals;
+  size_t next = 0;
+};
+
+// Frame intervals from the frame events of a trace CSV (--trace file.csv)
+bool loadTrace(const char *path, std::vector<double> &intervals);
+
+struct KeyEvent {
+  uint64_t frame;  // presented frame it landed in, 1 is the first after the macro was queued
+  double timeMs;   // since the macro was queued
+  double offsetMs; // since that frame was presented
+  uint16_t vkCode;
+  bool press;
+};
+
+struct Options {
+  int forcedMultiplier = 0;  // pins the frame generation multiplier like --framegen, 0 detects it
+  uint64_t warmupFrames = 0; // so frame generation detection and prediction have something to go on
+  uint64_t maxFrames = 10000;
+  double pollLatencyMs = 0;  // frames get noticed uniformly up to this long after they're presented
+  uint32_t seed = 1;         // for the poll latency
+  uint64_t holdFrames = 60;  // frames after queueing a whileHeld macro's key is let go
+};
+
+struct Queued {
+  const Macro::Program *program;
+  uint32_t times = 1; // like Keybinds::MacroKeybind::times
+};
+
+// Runs warmupFrames, then queues each program on its own lane (the first on
+// lane 0) like keybinds would and runs frames until every lane is empty
+// again or maxFrames is reached. The scheduler runs in whatever
+// InputHandler::timingMode is set to.
+std::vector<KeyEvent> run(std::span<const Queued> programs, FrameClock &clock,
+                          const Options &options = {});
+
+inline std::vector<KeyEvent> run(const Macro::Program &program, FrameClock &clock,
+                                 const Options &options = {}) {
+  Queued queued[] = {{&program}};
+  return run(queued, clock, options);
+}
+} // namespace Simulator
+
+#endif
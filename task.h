@@ -0,0 +1,162 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Macro {
+struct Program;
+}
+
+namespace InputHandler {
+// Move-only void() callable stored inline. Anything bigger than the buffer
+// is a compile error instead of a silent heap allocation. 64 bytes still fits
+// a whole std::function (MSVC's is that big) for callbacks that need one.
+class InlineCallback {
+public:
+  static constexpr size_t bufferSize = 64;
+
+  InlineCallback() = default;
+
+  template <typename F, typename Fn = std::decay_t<F>,
+            typename = std::enable_if_t<!std::is_same_v<Fn, InlineCallback>>>
+  InlineCallback(F &&function) {
+    static_assert(sizeof(Fn) <= bufferSize, "Callback captures too much to store inline");
+    static_assert(alignof(Fn) <= alignof(void *));
+    static_assert(std::is_nothrow_move_constructible_v<Fn>);
+    new (storage) Fn(std::forward<F>(function));
+    ops = &opsFor<Fn>;
+  }
+
+  InlineCallback(InlineCallback &&other) noexcept { moveFrom(other); }
+
+  InlineCallback &operator=(InlineCallback &&other) noexcept {
+    if (this != &other) {
+      reset();
+      moveFrom(other);
+    }
+    return *this;
+  }
+
+  InlineCallback(const InlineCallback &) = delete;
+  InlineCallback &operator=(const InlineCallback &) = delete;
+
+  ~InlineCallback() { reset(); }
+
+  explicit operator bool() const { return ops != nullptr; }
+  void operator()() { ops->invoke(storage); }
+
+  void reset() {
+    if (ops != nullptr) {
+      ops->destroy(storage);
+      ops = nullptr;
+    }
+  }
+
+private:
+  struct Ops {
+    void (*invoke)(void *);
+    void (*move)(void *from, void *to);
+    void (*destroy)(void *);
+  };
+
+  template <typename Fn>
+  static constexpr Ops opsFor = {
+      [](void *self) { (*static_cast<Fn *>(self))(); },
+      [](void *from, void *to) {
+        new (to) Fn(std::move(*static_cast<Fn *>(from)));
+        static_cast<Fn *>(from)->~Fn();
+      },
+      [](void *self) { static_cast<Fn *>(self)->~Fn(); }};
+
+  void moveFrom(InlineCallback &other) {
+    ops = other.ops;
+    if (ops != nullptr) {
+      ops->move(other.storage, storage);
+      other.ops = nullptr;
+    }
+  }
+
+  alignas(void *) unsigned char storage[bufferSize];
+  const Ops *ops = nullptr;
+};
+
+enum class TaskType : uint8_t {
+  Sleep, // does nothing for a frame
+  KeyDown,
+  KeyUp,
+  Wheel,
+  Callback,
+  Program, // steps through a precompiled Macro::Program, one frame at a time
+};
+
+// One frame-synchronized step. Plain data apart from the callback, so it moves
+// in and out of the task ring without touching the heap. The callback goes
+// first so the small fields pack into its tail padding.
+struct Task {
+  InlineCallback callback;
+  TaskType type = TaskType::Sleep;
+  bool recursive = false; // run the next task in the same frame
+  uint16_t vkCode = 0;
+  int delay = 0; // frames to wait before running
+  uint32_t pc = 0; // next instruction of program
+  // Times program starts over after its last instruction. repeatForever
+  // keeps going while vkCode is held and stops cleanly once it isn't.
+  uint32_t repeats = 0;
+  const Macro::Program *program = nullptr;
+
+  static constexpr uint32_t repeatForever = UINT32_MAX;
+
+  static Task sleep(bool recursive) {
+    Task task;
+    task.recursive = recursive;
+    return task;
+  }
+
+  static Task key(uint16_t vkCode, bool pressDown, bool recursive) {
+    Task task;
+    task.type = pressDown ? TaskType::KeyDown : TaskType::KeyUp;
+    task.recursive = recursive;
+    task.vkCode = vkCode;
+    return task;
+  }
+
+  static Task wheel(uint16_t vkCode, bool recursive) {
+    Task task;
+    task.type = TaskType::Wheel;
+    task.recursive = recursive;
+    task.vkCode = vkCode;
+    return task;
+  }
+
+  static Task run(const Macro::Program *program, uint32_t times = 1) {
+    Task task;
+    task.type = TaskType::Program;
+    task.program = program;
+    task.repeats = times > 1 ? times - 1 : 0;
+    return task;
+  }
+
+  static Task runWhileHeld(const Macro::Program *program, uint16_t vkCode) {
+    Task task = run(program);
+    task.repeats = repeatForever;
+    task.vkCode = vkCode;
+    return task;
+  }
+
+  static Task call(InlineCallback callback, bool recursive) {
+    Task task;
+    task.type = TaskType::Callback;
+    task.recursive = recursive;
+    task.callback = std::move(callback);
+    return task;
+  }
+};
+
+static_assert(sizeof(Task) <= 96);
+} // namespace InputHandler
+
+#endif
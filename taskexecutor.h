@@ -0,0 +1,68 @@
+#ifndef TASKEXECUTOR_H
+#define TASKEXECUTOR_H
+
+#include "task.h"
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace InputHandler {
+// Worker thread for things that shouldn't run on the frame thread, user
+// callbacks mostly. Takes InlineCallbacks so a task's callback can be moved
+// straight over.
+class TaskExecutor {
+public:
+  ~TaskExecutor() {
+    if (worker.joinable()) {
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        stop_thread = true;
+      }
+      condition.notify_one();
+      worker.join();
+    }
+  }
+
+  void start() { worker = std::thread(&TaskExecutor::loop, this); }
+
+  void enqueue(InlineCallback task) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      if (stop_thread) {
+        return;
+      }
+      tasks.push(std::move(task));
+    }
+    condition.notify_one();
+  }
+
+private:
+  void loop() {
+    while (true) {
+      InlineCallback task;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        condition.wait(lock, [this] { return !tasks.empty() || stop_thread; });
+
+        if (stop_thread && tasks.empty()) {
+          return;
+        }
+
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+
+      task();
+    }
+  }
+
+  std::thread worker;
+  std::queue<InlineCallback> tasks;
+  std::mutex queue_mutex;
+  std::condition_variable condition;
+  bool stop_thread = false;
+};
+} // namespace InputHandler
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef TASKRING_H
+#define TASKRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+// Bounded lock-free queue with preallocated slots. Any number of threads can
+// push (keyboard hook, callbacks running on the executor), exactly one thread
+// may consume with front()/pop(). Nobody ever blocks: a full ring makes push
+// fail and an empty one makes front return nullptr.
+//
+// Every slot carries a sequence number (Vyukov's bounded queue). A slot is
+// free for the producer claiming position pos when its sequence is pos, and
+// holds a finished value for the consumer when it is pos + 1. Values only
+// live in a slot between push and pop, a free slot is raw storage, so neither
+// side pays for building or assigning a T it's about to throw away.
+template <typename T, size_t Capacity> class TaskRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  TaskRing() {
+    for (size_t i = 0; i < Capacity; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~TaskRing() {
+    while (front() != nullptr) {
+      pop();
+    }
+  }
+
+  TaskRing(const TaskRing &) = delete;
+  TaskRing &operator=(const TaskRing &) = delete;
+
+  bool push(T &&value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots[pos & (Capacity - 1)];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false; // Full, the consumer hasn't released this slot yet
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    new (slot->storage) T(std::move(value));
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool push(const T &value) { return push(T(value)); }
+
+  // Consumer only. The value stays owned by the ring until pop(), so it can be
+  // modified in place or moved out.
+  T *front() {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Slot &slot = slots[pos & (Capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+      return nullptr;
+    }
+    return slot.value();
+  }
+
+  // Consumer only, call after front() returned a value. Destroys it, which is
+  // next to free for one that was moved out of.
+  void pop() {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Slot &slot = slots[pos & (Capacity - 1)];
+    std::destroy_at(slot.value());
+    slot.sequence.store(pos + Capacity, std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_release);
+  }
+
+  // Safe from any thread. A push that has claimed a slot but not finished
+  // writing it already counts, so front() can briefly lag behind this.
+  bool empty() const { return size() == 0; }
+
+  size_t size() const {
+    size_t dequeued = dequeuePos.load(std::memory_order_acquire);
+    size_t enqueued = enqueuePos.load(std::memory_order_acquire);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T *value() { return std::launder(reinterpret_cast<T *>(storage)); }
+  };
+
+  alignas(64) std::atomic<size_t> enqueuePos = 0;
+  alignas(64) std::atomic<size_t> dequeuePos = 0;
+  alignas(64) Slot slots[Capacity];
+};
+
+#endif
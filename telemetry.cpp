@@ -0,0 +1,255 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max instead of the macros
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Telemetry {
+static_assert(offsetof(Block<FrameBlock>, data) == 8);
+static_assert(offsetof(Block<StepBlock>, data) == 8);
+static_assert(offsetof(Block<HookBlock>, data) == 8);
+
+constexpr int maxReadAttempts = 8;
+#ifdef _WIN32
+constexpr const wchar_t *wideSegmentName = L"RTSSMacrosTelemetry"; // segmentName
+#endif
+
+// Whether the writer that set up a segment we found is still around
+static bool writerAlive(uint32_t processId) {
+#ifdef _WIN32
+  if (processId == GetCurrentProcessId()) {
+    return false;
+  }
+  HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+  if (process == nullptr) {
+    // Running as someone we can't look at counts as running
+    return GetLastError() == ERROR_ACCESS_DENIED;
+  }
+  DWORD exitCode;
+  bool alive = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+  CloseHandle(process);
+  return alive;
+#else
+  return processId != (uint32_t)getpid() && kill(processId, 0) == 0;
+#endif
+}
+
+bool Writer::open() {
+  close();
+#ifdef _WIN32
+  HANDLE handle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                     sizeof(Segment), wideSegmentName);
+  if (handle == nullptr) {
+    return false;
+  }
+  // A monitor that still has the last run's segment mapped keeps it around
+  bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+  void *view = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Segment));
+  if (view == nullptr) {
+    CloseHandle(handle);
+    return false;
+  }
+  uint32_t processId = GetCurrentProcessId();
+#else
+  // Left over if the last run crashed
+  std::string name = std::string("/") + segmentName;
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, sizeof(Segment)) != 0) {
+    ::close(fd);
+    return false;
+  }
+  void *view = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+  bool existed = true;
+  uint32_t processId = getpid();
+#endif
+  // Whoever set it up last is gone or closed it, it's ours then. One that's
+  // still publishing is left alone.
+  Header &header = static_cast<Segment *>(view)->header;
+  uint32_t found = std::atomic_ref<uint32_t>(header.signature).load(std::memory_order_acquire);
+  if (existed && found == signature && writerAlive(header.processId)) {
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+    CloseHandle(handle);
+#else
+    munmap(view, sizeof(Segment));
+#endif
+    return false;
+  }
+
+  std::atomic_ref<uint32_t>(header.signature).store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memset(reinterpret_cast<char *>(view) + sizeof(uint32_t), 0, sizeof(Segment) - sizeof(uint32_t));
+  header.version = version;
+  header.processId = processId;
+  header.frameOffset = offsetof(Segment, frame);
+  header.frameSize = sizeof(FrameBlock);
+  header.stepOffset = offsetof(Segment, steps);
+  header.stepSize = sizeof(StepBlock);
+  header.hookOffset = offsetof(Segment, hook);
+  header.hookSize = sizeof(HookBlock);
+  std::atomic_ref<uint32_t>(header.signature).store(signature, std::memory_order_release);
+#ifdef _WIN32
+  mapping = handle;
+#endif
+  segment.store(static_cast<Segment *>(view), std::memory_order_release);
+  return true;
+}
+
+// The view stays mapped, a thread that was in the middle of a publish
+// finishes into it instead of faulting. It goes away with the process.
+void Writer::close() {
+  Segment *closing = segment.exchange(nullptr, std::memory_order_acq_rel);
+  if (closing == nullptr) {
+    return;
+  }
+  // Readers and the next writer take this as nobody publishing anymore
+  std::atomic_ref<uint32_t>(closing->header.signature).store(0, std::memory_order_release);
+#ifdef _WIN32
+  CloseHandle(mapping);
+  mapping = nullptr;
+#else
+  std::string name = std::string("/") + segmentName;
+  shm_unlink(name.c_str());
+#endif
+}
+
+// The writer half of a seqlock: odd, the data, even again. The release fence
+// keeps the data from showing up before the odd sequence does, the release
+// store keeps it from showing up after the even one.
+template <typename T> static void writeBlock(Block<T> &block, const T &data) {
+  std::atomic_ref<uint32_t> sequence(block.sequence);
+  uint32_t start = sequence.load(std::memory_order_relaxed);
+  sequence.store(start + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&block.data, &data, sizeof(T));
+  sequence.store(start + 2, std::memory_order_release);
+}
+
+void Writer::publish(const FrameBlock &frame) {
+  if (Segment *current = segment.load(std::memory_order_relaxed)) {
+    writeBlock(current->frame, frame);
+  }
+}
+
+void Writer::publish(const StepBlock &steps) {
+  if (Segment *current = segment.load(std::memory_order_relaxed)) {
+    writeBlock(current->steps, steps);
+  }
+}
+
+void Writer::publish(const HookBlock &hook) {
+  if (Segment *current = segment.load(std::memory_order_relaxed)) {
+    writeBlock(current->hook, hook);
+  }
+}
+
+bool Reader::open() {
+  close();
+#ifdef _WIN32
+  HANDLE handle = OpenFileMappingW(FILE_MAP_READ, FALSE, wideSegmentName);
+  if (handle == nullptr) {
+    return false;
+  }
+  void *view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(handle); // the view keeps it open
+  if (view == nullptr) {
+    return false;
+  }
+  mappedSize = 0;
+#else
+  std::string name = std::string("/") + segmentName;
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header)) {
+    ::close(fd);
+    return false;
+  }
+  void *view = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+  mappedSize = info.st_size;
+#endif
+  segment = static_cast<const Header *>(view);
+  uint32_t found = std::atomic_ref<uint32_t>(const_cast<uint32_t &>(segment->signature))
+                       .load(std::memory_order_acquire);
+  if (found != signature || (segment->version >> 16) != (version >> 16)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void Reader::close() {
+  if (segment == nullptr) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(segment);
+#else
+  munmap(const_cast<Header *>(segment), mappedSize);
+#endif
+  segment = nullptr;
+}
+
+// Copies whatever of the block both sides know about, fields from a newer
+// minor version are cut off and ones from an older one left zero
+bool Reader::readBlock(uint32_t offset, uint32_t size, void *data, size_t dataSize) {
+  memset(data, 0, dataSize);
+  size_t copied = std::min<size_t>(size, dataSize);
+  if (mappedSize != 0 && offset + 8 + copied > mappedSize) {
+    return false;
+  }
+  const char *block = reinterpret_cast<const char *>(segment) + offset;
+  std::atomic_ref<uint32_t> sequence(*reinterpret_cast<uint32_t *>(const_cast<char *>(block)));
+  for (int attempt = 0; attempt < maxReadAttempts; attempt++) {
+    uint32_t before = sequence.load(std::memory_order_acquire);
+    if ((before & 1) == 0) {
+      memcpy(data, block + 8, copied);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    retries++;
+  }
+  tornReads++;
+  return false;
+}
+
+bool Reader::read(FrameBlock &frame) {
+  return readBlock(segment->frameOffset, segment->frameSize, &frame, sizeof(frame));
+}
+
+bool Reader::read(StepBlock &steps) {
+  return readBlock(segment->stepOffset, segment->stepSize, &steps, sizeof(steps));
+}
+
+bool Reader::read(HookBlock &hook) {
+  return readBlock(segment->hookOffset, segment->hookSize, &hook, sizeof(hook));
+}
+} // namespace Telemetry
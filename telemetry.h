@@ -0,0 +1,136 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// What the tool is doing right now, published in shared memory the same way
+// RTSS publishes frames, so an overlay or the monitor tool can look at it
+// whenever it wants without asking us. The segment is named
+// RTSSMacrosTelemetry (a POSIX shm object of that name off Windows).
+//
+// The data is split into blocks by which thread writes it, each with its own
+// sequence number that is odd while the block is being written. Readers copy
+// a block and keep it only if the sequence was even and didn't change, so
+// writers never wait for anyone and never make a syscall to publish. Every
+// block sits on its own cache lines so the writers don't share any either.
+namespace Telemetry {
+constexpr uint32_t signature = 0x4D535452; // 'RTSM' once the segment is initialized
+// Major in the high 16 bits. Minor versions only add fields to the end of
+// blocks, readers of an older minor just don't see them.
+constexpr uint32_t version = 0x00010000;
+constexpr const char *segmentName = "RTSSMacrosTelemetry";
+constexpr int maxLanes = 8; // same as InputHandler::maxLanes
+
+// Written by the frame thread for every present
+struct FrameBlock {
+  uint64_t index;     // frames seen since the frame source attached
+  uint64_t missed;    // presents that came and went between two polls
+  uint64_t hitches;   // see framestats.h
+  double frametimeMs; // of the last present
+  double p50Ms;       // over the last ~1000 frames
+  double p99Ms;
+  uint32_t queued; // tasks on every lane, a macro counts as one
+  uint32_t activeLanes;
+  int64_t updatedNs; // steady clock, same clock in every process
+};
+
+struct LaneState {
+  char macro[32]; // name of the running macro, empty for plain tasks
+  uint32_t step;  // next instruction of it
+  uint32_t steps; // instructions in it
+  uint32_t queued;
+  uint32_t repeating; // rounds left after this one, UINT32_MAX while held
+};
+
+// Written by whatever runs steps, after every frame that ran some
+struct StepBlock {
+  uint64_t frameIndex; // the frame the steps were for
+  uint64_t frames;     // frames that ran steps
+  int64_t lastLatencyNs; // frame detected to its inputs submitted, the last time there were any
+  LaneState lanes[maxLanes];
+};
+
+// Written by the keyboard hook thread for every physical event of a bound
+// key, the dispatch time covers the focus check and running the keybind
+struct HookBlock {
+  uint64_t events;
+  uint64_t eaten; // kept from the game
+  int64_t lastDispatchNs;
+  int64_t maxDispatchNs;
+};
+
+template <typename T> struct alignas(64) Block {
+  uint32_t sequence;
+  uint32_t reserved;
+  T data; // always 8 bytes in
+};
+
+// Offsets are of the blocks from the start of the segment, sizes of their
+// data. The signature is written last, a reader that sees it can trust the
+// rest of the header.
+struct Header {
+  uint32_t signature;
+  uint32_t version;
+  uint32_t processId; // of the writer
+  uint32_t frameOffset, frameSize;
+  uint32_t stepOffset, stepSize;
+  uint32_t hookOffset, hookSize;
+};
+
+struct Segment {
+  Header header;
+  Block<FrameBlock> frame;
+  Block<StepBlock> steps;
+  Block<HookBlock> hook;
+};
+
+// Creates and owns the segment. Each publish may only ever be called from
+// one thread, a different one per block is fine. A segment left behind by a
+// writer that died is taken over, one whose writer is still running isn't.
+// Nothing is closed on destruction, detached threads can still be publishing
+// while statics go away.
+class Writer {
+public:
+  bool open();
+  // Safe while other threads publish, they stop once they see it
+  void close();
+  bool isOpen() const { return segment.load(std::memory_order_relaxed) != nullptr; }
+
+  void publish(const FrameBlock &frame);
+  void publish(const StepBlock &steps);
+  void publish(const HookBlock &hook);
+
+private:
+  std::atomic<Segment *> segment = nullptr;
+  void *mapping = nullptr; // the file mapping handle on Windows, keeps the name alive
+};
+
+// Maps somebody else's segment read only
+class Reader {
+public:
+  ~Reader() { close(); }
+  // False if nobody is publishing or the major version is different
+  bool open();
+  void close();
+  bool isOpen() const { return segment != nullptr; }
+  const Header &header() const { return *segment; }
+
+  // False if the writer kept changing the block while it was copied
+  bool read(FrameBlock &frame);
+  bool read(StepBlock &steps);
+  bool read(HookBlock &hook);
+
+  uint64_t retries = 0;
+  uint64_t tornReads = 0;
+
+private:
+  bool readBlock(uint32_t offset, uint32_t size, void *data, size_t dataSize);
+
+  const Header *segment = nullptr;
+  size_t mappedSize = 0; // 0 if the platform doesn't tell us
+};
+} // namespace Telemetry
+
+#endif
@@ -0,0 +1,121 @@
+#include "trace.h"
+#include <cstring>
+
+using namespace std::chrono_literals;
+
+namespace Trace {
+
+void Summary::print(FILE *file) const {
+  fprintf(file, "%llu frames, %llu missed, %llu tasks, %llu late\n",
+          (unsigned long long)frames, (unsigned long long)framesMissed,
+          (unsigned long long)tasksExecuted, (unsigned long long)tasksLate);
+  frameToInput.print(file, "frame to input");
+}
+
+bool Exporter::start(const char *path) {
+  if (path != nullptr) {
+    size_t length = strlen(path);
+    csv = length >= 4 && strcmp(path + length - 4, ".csv") == 0;
+    file = fopen(path, csv ? "w" : "wb");
+    if (file == nullptr) {
+      return false;
+    }
+    if (csv) {
+      fprintf(file, "type,frame,timestamp_ns,detail\n");
+    } else {
+      uint32_t header[4] = {fileMagic, fileVersion, (uint32_t)sizeof(Event), 0};
+      fwrite(header, sizeof(header), 1, file);
+    }
+  }
+  running = true;
+  worker = std::thread(&Exporter::loop, this);
+  return true;
+}
+
+void Exporter::stop() {
+  if (worker.joinable()) {
+    running = false;
+    worker.join();
+  }
+  drain();
+  if (file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+}
+
+void Exporter::loop() {
+  while (running.load(std::memory_order_relaxed)) {
+    drain();
+    std::this_thread::sleep_for(50ms);
+  }
+}
+
+void Exporter::drain() {
+  static const char *typeNames[] = {"none", "frame", "dequeue", "input", "predicted"};
+  while (Event *event = recorder.events.front()) {
+    consume(*event);
+    if (file != nullptr) {
+      if (csv) {
+        fprintf(file, "%s,%llu,%lld,%u\n", typeNames[(int)event->type],
+                (unsigned long long)event->frame, (long long)event->timestampNs,
+                event->detail);
+      } else {
+        fwrite(event, sizeof(Event), 1, file);
+      }
+    }
+    recorder.events.pop();
+  }
+  if (file != nullptr) {
+    fflush(file);
+  }
+}
+
+void Exporter::consume(const Event &event) {
+  switch (event.type) {
+  case EventType::FrameDetected:
+    stats.frames++;
+    if (event.detail > 1) {
+      stats.framesMissed += event.detail - 1;
+    }
+    // Already stepped ahead of it, keep pairing against the prediction
+    if (currentFramePredicted && event.frame == currentFrame) {
+      currentFramePredicted = false;
+      break;
+    }
+    currentFramePredicted = false;
+    currentFrame = event.frame;
+    currentFrameNs = event.timestampNs;
+    currentFrameLate = event.detail > 1;
+    currentFrameHasInput = false;
+    break;
+  case EventType::FramePredicted:
+    // Usually lands before the frame it's for is detected, latency counts
+    // from the predicted present like the scheduler's own does
+    if (event.frame != currentFrame) {
+      currentFrame = event.frame;
+      currentFrameLate = false;
+      currentFrameHasInput = false;
+    }
+    currentFrameNs = event.timestampNs;
+    currentFramePredicted = true;
+    break;
+  case EventType::TaskDequeued:
+    stats.tasksExecuted++;
+    if (currentFrameLate && event.frame == currentFrame) {
+      stats.tasksLate++;
+    }
+    break;
+  case EventType::InputSubmitted:
+    // Producers on different threads can land slightly out of order, only
+    // pair an input with the frame it says it belongs to
+    if (!currentFrameHasInput && event.frame == currentFrame) {
+      currentFrameHasInput = true;
+      stats.frameToInput.record(std::chrono::nanoseconds(event.timestampNs - currentFrameNs));
+    }
+    break;
+  case EventType::None:
+    break;
+  }
+}
+} // namespace Trace
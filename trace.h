@@ -0,0 +1,97 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "latency.h"
+#include "taskring.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+// Timestamps for every step between a frame showing up and its inputs going
+// out. Recording is a push into a preallocated lock-free ring, the file and
+// the stats are done by a background thread so the frame thread never
+// touches stdio.
+namespace Trace {
+using Clock = std::chrono::steady_clock;
+
+enum class EventType : uint8_t {
+  None,
+  FrameDetected,  // detail is how many frames advanced, >1 means missed ones
+  TaskDequeued,   // detail is the task's vk code, or 0
+  InputSubmitted, // detail is how many inputs went out in the batch
+  FramePredicted, // a predicted step ran, timestamp is the predicted present
+};
+
+struct Event {
+  int64_t timestampNs = 0; // steady clock
+  uint64_t frame = 0;
+  uint32_t detail = 0;
+  EventType type = EventType::None;
+};
+
+class Recorder {
+public:
+  // Any thread. Drops the event if the exporter fell behind.
+  void record(EventType type, uint64_t frame, uint32_t detail = 0,
+              Clock::time_point at = Clock::now()) {
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+    if (!events.push(Event{ns, frame, detail, type})) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  TaskRing<Event, 1 << 14> events;
+  std::atomic<uint64_t> dropped = 0;
+};
+
+// Worked out from the event stream
+struct Summary {
+  Latency::Histogram frameToInput; // frame detected to the first input of that frame
+  uint64_t frames = 0;
+  uint64_t framesMissed = 0;
+  uint64_t tasksExecuted = 0;
+  uint64_t tasksLate = 0; // ran in a frame that came after missed frames
+
+  void print(FILE *file) const;
+};
+
+// Drains a Recorder on its own thread. With a path the events are also
+// written out, as CSV if the path ends in .csv and as a header followed by
+// raw Events otherwise.
+class Exporter {
+public:
+  static constexpr uint32_t fileMagic = 0x43525452; // 'RTRC'
+  static constexpr uint32_t fileVersion = 2;
+
+  Exporter(Recorder &recorder) : recorder(recorder) {}
+  ~Exporter() { stop(); }
+
+  bool start(const char *path = nullptr);
+  void stop();
+
+  // Only consistent once stopped, good enough for a progress line otherwise
+  const Summary &summary() const { return stats; }
+
+private:
+  void loop();
+  void drain();
+  void consume(const Event &event);
+
+  Recorder &recorder;
+  FILE *file = nullptr;
+  bool csv = false;
+  std::thread worker;
+  std::atomic<bool> running = false;
+
+  Summary stats;
+  uint64_t currentFrame = 0;
+  int64_t currentFrameNs = 0;
+  bool currentFrameLate = false;
+  bool currentFrameHasInput = true;
+  bool currentFramePredicted = false;
+};
+} // namespace Trace
+
+#endif